@@ -165,7 +165,9 @@ SDL_Surface* GFX_init(int mode) {
 	return gfx.screen;
 }
 
+static void GFX_freeTextCache(void);
 void GFX_quit(void) {
+	GFX_freeTextCache();
 	TTF_CloseFont(font.large);
 	TTF_CloseFont(font.medium);
 	TTF_CloseFont(font.small);
@@ -226,17 +228,98 @@ void GFX_sync(void) {
 FALLBACK_IMPLEMENTATION int PLAT_supportsOverscan(void) { return 0; }
 FALLBACK_IMPLEMENTATION void PLAT_setEffectColor(int next_color) { }
 
+// fills pens[i] with the width of the first i bytes of str, summed from glyph advances
+// bytes inside a UTF-8 sequence repeat the width before their lead byte, kerning is ignored
+static void GFX_sumAdvances(TTF_Font* font, const char* str, int len, int* pens) {
+	int ascii[128];
+	for (int i=0; i<128; i++) ascii[i] = -1;
+	
+	// SDL_ttf may move the pen further than the glyph advance (eg. the bold overhang)
+	int one_space,two_spaces,space_advance = 0;
+	TTF_SizeUTF8(font, " ", &one_space, NULL);
+	TTF_SizeUTF8(font, "  ", &two_spaces, NULL);
+	TTF_GlyphMetrics(font, ' ', NULL,NULL,NULL,NULL, &space_advance);
+	int extra = two_spaces - one_space - space_advance;
+	if (extra<0) extra = 0;
+	
+	int pen = 0;
+	int i = 0;
+	while (i<len) {
+		const unsigned char* s = (const unsigned char*)str + i;
+		uint32_t codepoint = s[0];
+		int size = 1;
+		if (s[0]>=0x80) {
+			if ((s[0] & 0xE0)==0xC0) { codepoint = s[0] & 0x1F; size = 2; }
+			else if ((s[0] & 0xF0)==0xE0) { codepoint = s[0] & 0x0F; size = 3; }
+			else if ((s[0] & 0xF8)==0xF0) { codepoint = s[0] & 0x07; size = 4; }
+			else size = 0;
+			
+			if (i+size>len) size = 0;
+			for (int j=1; j<size; j++) {
+				if ((s[j] & 0xC0)!=0x80) { size = 0; break; }
+				codepoint = (codepoint << 6) | (s[j] & 0x3F);
+			}
+			
+			// invalid sequences count as a single U+FFFD byte, like SDL_ttf draws them
+			if (size==0) { codepoint = 0xFFFD; size = 1; }
+		}
+		
+		int advance = codepoint<128 ? ascii[codepoint] : -1;
+		if (advance<0) {
+			if (codepoint>0xFFFF || TTF_GlyphMetrics(font, codepoint, NULL,NULL,NULL,NULL, &advance)!=0) {
+				// no metrics for this glyph, measure the sequence itself
+				char glyph[5] = {0};
+				if (codepoint==0xFFFD) strcpy(glyph, "\xEF\xBF\xBD");
+				else memcpy(glyph, s, size);
+				TTF_SizeUTF8(font, glyph, &advance, NULL);
+				advance -= extra;
+			}
+			advance += extra;
+			if (codepoint<128) ascii[codepoint] = advance;
+		}
+		
+		for (int j=0; j<size; j++) pens[i+j] = pen;
+		pen += advance;
+		i += size;
+	}
+	pens[len] = pen;
+}
+
 int GFX_truncateText(TTF_Font* font, const char* in_name, char* out_name, int max_width, int padding) {
 	int text_width;
 	strcpy(out_name, in_name);
 	TTF_SizeUTF8(font, out_name, &text_width, NULL);
 	text_width += padding;
+	if (text_width<=max_width) return text_width;
+	
+	int len = strlen(in_name);
+	int* pens = malloc(sizeof(int) * (len+1));
+	if (!pens) return text_width;
+	GFX_sumAdvances(font, in_name, len, pens);
+	
+	int ellipsis_width;
+	TTF_SizeUTF8(font, "...", &ellipsis_width, NULL);
+	
+	// binary search the longest prefix that fits with the ellipsis,
+	// never longer than the input since out_name may be sized for it
+	int lo = 0;
+	int hi = len>3 ? len-3 : 0;
+	while (lo<hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (pens[mid]+ellipsis_width+padding<=max_width) lo = mid;
+		else hi = mid - 1;
+	}
+	free(pens);
 	
-	while (text_width>max_width) {
-		int len = strlen(out_name);
-		strcpy(&out_name[len-4], "...\0");
+	// the sums ignore kerning so step back a glyph at a time until the real width fits
+	while (1) {
+		while (lo>0 && (in_name[lo] & 0xC0)==0x80) lo -= 1; // don't split a UTF-8 sequence
+		memcpy(out_name, in_name, lo);
+		strcpy(&out_name[lo], "...");
 		TTF_SizeUTF8(font, out_name, &text_width, NULL);
 		text_width += padding;
+		if (text_width<=max_width || lo==0) break;
+		lo -= 1;
 	}
 	
 	return text_width;
@@ -256,16 +339,22 @@ int GFX_wrapText(TTF_Font* font, char* str, int max_width, int max_lines) {
 		return line_width;
 	}
 	
+	// the width of any span is the difference of two sums
+	int len = strlen(str);
+	int* pens = malloc(sizeof(int) * (len+1));
+	if (!pens) return line_width;
+	GFX_sumAdvances(font, str, len, pens);
+	
 	char* prev = NULL;
 	char* tmp = line;
 	int lines = 1;
-	int i = 0;
 	while (!max_lines || lines<max_lines) {
 		tmp = strchr(tmp, ' ');
 		if (!tmp) {
 			if (prev) {
-				TTF_SizeUTF8(font, line, &line_width, NULL);
+				line_width = pens[len] - pens[line-str];
 				if (line_width>=max_width) {
+					line_width = pens[prev-str] - pens[line-str];
 					if (line_width>max_line_width) max_line_width = line_width;
 					prev[0] = '\n';
 					line = prev + 1;
@@ -273,26 +362,19 @@ int GFX_wrapText(TTF_Font* font, char* str, int max_width, int max_lines) {
 			}
 			break;
 		}
-		tmp[0] = '\0';
 		
-		TTF_SizeUTF8(font, line, &line_width, NULL);
-
-		if (line_width>=max_width) { // wrap
+		line_width = pens[tmp-str] - pens[line-str];
+		if (line_width>=max_width && prev) { // wrap
+			line_width = pens[prev-str] - pens[line-str];
 			if (line_width>max_line_width) max_line_width = line_width;
-			tmp[0] = ' ';
-			tmp += 1;
 			prev[0] = '\n';
-			prev += 1;
-			line = prev;
+			line = prev + 1;
 			lines += 1;
 		}
-		else { // continue
-			tmp[0] = ' ';
-			prev = tmp;
-			tmp += 1;
-		}
-		i += 1;
+		prev = tmp;
+		tmp += 1;
 	}
+	free(pens);
 	
 	line_width = GFX_truncateText(font,line,buffer,max_width,0);
 	strcpy(line,buffer);
@@ -608,6 +690,45 @@ int GFX_getButtonWidth(char* hint, char* button) {
 	button_width += width + SCALE1(BUTTON_MARGIN);
 	return button_width;
 }
+// button labels and hints are the same every frame, keep them rendered
+#define TEXT_CACHE_SIZE 16
+static struct TextCacheEntry {
+	TTF_Font* font;
+	SDL_Color color;
+	char text[64];
+	SDL_Surface* surface;
+} text_cache[TEXT_CACHE_SIZE];
+static int text_cache_next = 0;
+static SDL_Surface* GFX_renderCachedText(TTF_Font* font, char* str, SDL_Color color) {
+	for (int i=0; i<TEXT_CACHE_SIZE; i++) {
+		struct TextCacheEntry* entry = &text_cache[i];
+		if (entry->surface && entry->font==font && entry->color.r==color.r && entry->color.g==color.g && entry->color.b==color.b && !strcmp(entry->text, str)) return entry->surface;
+	}
+	
+	SDL_Surface* text = TTF_RenderUTF8_Blended(font, str, color);
+	if (!text || strlen(str)>=sizeof(text_cache[0].text)) return text; // caller frees uncached text
+	
+	struct TextCacheEntry* entry = &text_cache[text_cache_next];
+	text_cache_next = (text_cache_next + 1) % TEXT_CACHE_SIZE;
+	if (entry->surface) SDL_FreeSurface(entry->surface);
+	entry->font = font;
+	entry->color = color;
+	strcpy(entry->text, str);
+	entry->surface = text;
+	return text;
+}
+static void GFX_releaseCachedText(SDL_Surface* text) {
+	for (int i=0; i<TEXT_CACHE_SIZE; i++) {
+		if (text_cache[i].surface==text) return;
+	}
+	SDL_FreeSurface(text);
+}
+static void GFX_freeTextCache(void) {
+	for (int i=0; i<TEXT_CACHE_SIZE; i++) {
+		if (text_cache[i].surface) SDL_FreeSurface(text_cache[i].surface);
+		text_cache[i].surface = NULL;
+	}
+}
 void GFX_blitButton(char* hint, char*button, SDL_Surface* dst, SDL_Rect* dst_rect) {
 	SDL_Surface* text;
 	int ox = 0;
@@ -619,13 +740,13 @@ void GFX_blitButton(char* hint, char*button, SDL_Surface* dst, SDL_Rect* dst_rec
 		GFX_blitAsset(ASSET_BUTTON, NULL, dst, dst_rect);
 
 		// label
-		text = TTF_RenderUTF8_Blended(font.medium, button, COLOR_BUTTON_TEXT);
+		text = GFX_renderCachedText(font.medium, button, COLOR_BUTTON_TEXT);
 		SDL_BlitSurface(text, NULL, dst, &(SDL_Rect){dst_rect->x+(SCALE1(BUTTON_SIZE)-text->w)/2,dst_rect->y+(SCALE1(BUTTON_SIZE)-text->h)/2});
 		ox += SCALE1(BUTTON_SIZE);
-		SDL_FreeSurface(text);
+		GFX_releaseCachedText(text);
 	}
 	else {
-		text = TTF_RenderUTF8_Blended(special_case ? font.large : font.tiny, button, COLOR_BUTTON_TEXT);
+		text = GFX_renderCachedText(special_case ? font.large : font.tiny, button, COLOR_BUTTON_TEXT);
 		GFX_blitPill(ASSET_BUTTON, dst, &(SDL_Rect){dst_rect->x,dst_rect->y,SCALE1(BUTTON_SIZE)/2+text->w,SCALE1(BUTTON_SIZE)});
 		ox += SCALE1(BUTTON_SIZE)/4;
 		
@@ -633,15 +754,15 @@ void GFX_blitButton(char* hint, char*button, SDL_Surface* dst, SDL_Rect* dst_rec
 		SDL_BlitSurface(text, NULL, dst, &(SDL_Rect){ox+dst_rect->x,oy+dst_rect->y+(SCALE1(BUTTON_SIZE)-text->h)/2,text->w,text->h});
 		ox += text->w;
 		ox += SCALE1(BUTTON_SIZE)/4;
-		SDL_FreeSurface(text);
+		GFX_releaseCachedText(text);
 	}
 	
 	ox += SCALE1(BUTTON_MARGIN);
 
 	// hint text
-	text = TTF_RenderUTF8_Blended(font.small, hint, COLOR_WHITE);
+	text = GFX_renderCachedText(font.small, hint, COLOR_WHITE);
 	SDL_BlitSurface(text, NULL, dst, &(SDL_Rect){ox+dst_rect->x,dst_rect->y+(SCALE1(BUTTON_SIZE)-text->h)/2,text->w,text->h});
-	SDL_FreeSurface(text);
+	GFX_releaseCachedText(text);
 }
 void GFX_blitMessage(TTF_Font* font, char* msg, SDL_Surface* dst, SDL_Rect* dst_rect) {
 	if (!dst_rect) dst_rect = &(SDL_Rect){0,0,dst->w,dst->h};
@@ -0,0 +1,666 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image_scale.h"
+
+// the image scaler uses the vector unit when the target has one (SCALE_NO_SIMD forces the scalar loops)
+#if defined(SCALE_NO_SIMD)
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCALE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCALE_SSE2
+#endif
+
+// scale_accumulate_row_32 adds the channels of a row of 32-bit pixels to the row sums
+void scale_accumulate_row_32(Uint32 *sums, const Uint8 *row, int width)
+{
+    int x = 0;
+#if defined(SCALE_NEON)
+    // 4 pixels at a time: widen the bytes to 16 then 32 bits and add them
+    for (; x + 4 <= width; x += 4)
+    {
+        uint8x16_t pixels = vld1q_u8(row + x * 4);
+        uint16x8_t low = vmovl_u8(vget_low_u8(pixels));
+        uint16x8_t high = vmovl_u8(vget_high_u8(pixels));
+        Uint32 *sum = sums + x * 4;
+        vst1q_u32(sum, vaddw_u16(vld1q_u32(sum), vget_low_u16(low)));
+        vst1q_u32(sum + 4, vaddw_u16(vld1q_u32(sum + 4), vget_high_u16(low)));
+        vst1q_u32(sum + 8, vaddw_u16(vld1q_u32(sum + 8), vget_low_u16(high)));
+        vst1q_u32(sum + 12, vaddw_u16(vld1q_u32(sum + 12), vget_high_u16(high)));
+    }
+#elif defined(SCALE_SSE2)
+    // 4 pixels at a time: unpack the bytes to 16 then 32 bits and add them
+    __m128i zero = _mm_setzero_si128();
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(row + x * 4));
+        __m128i low = _mm_unpacklo_epi8(pixels, zero);
+        __m128i high = _mm_unpackhi_epi8(pixels, zero);
+        __m128i *sum = (__m128i *)(sums + x * 4);
+        _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), _mm_unpacklo_epi16(low, zero)));
+        _mm_storeu_si128(sum + 1, _mm_add_epi32(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi16(low, zero)));
+        _mm_storeu_si128(sum + 2, _mm_add_epi32(_mm_loadu_si128(sum + 2), _mm_unpacklo_epi16(high, zero)));
+        _mm_storeu_si128(sum + 3, _mm_add_epi32(_mm_loadu_si128(sum + 3), _mm_unpackhi_epi16(high, zero)));
+    }
+#endif
+    for (int i = x * 4; i < width * 4; i++)
+    {
+        sums[i] += row[i];
+    }
+}
+
+// scale_accumulate_row_16 adds the masked channels of a row of 16-bit pixels to the row sums
+void scale_accumulate_row_16(Uint32 *sums, const Uint8 *row, int width, const SDL_PixelFormat *format)
+{
+    const Uint16 *pixels = (const Uint16 *)row;
+    for (int x = 0; x < width; x++)
+    {
+        Uint32 pixel = pixels[x];
+        Uint32 *sum = sums + x * 4;
+        sum[0] += (pixel & format->Rmask) >> format->Rshift;
+        sum[1] += (pixel & format->Gmask) >> format->Gshift;
+        sum[2] += (pixel & format->Bmask) >> format->Bshift;
+        sum[3] += format->Amask ? (pixel & format->Amask) >> format->Ashift : 0;
+    }
+}
+
+// scale_accumulate_row_bytes adds every byte of a row of pixels to the row sums
+void scale_accumulate_row_bytes(Uint32 *sums, const Uint8 *row, int width, int bpp)
+{
+    for (int i = 0; i < width * bpp; i++)
+    {
+        sums[i] += row[i];
+    }
+}
+
+// scale_sum_columns adds up the row sums of the 32-bit pixels from x0 to x1 (4 channels)
+void scale_sum_columns(const Uint32 *sums, int x0, int x1, Uint32 *total)
+{
+#if defined(SCALE_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (int x = x0; x < x1; x++)
+    {
+        acc = vaddq_u32(acc, vld1q_u32(sums + x * 4));
+    }
+    vst1q_u32(total, acc);
+#elif defined(SCALE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (int x = x0; x < x1; x++)
+    {
+        acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i *)(sums + x * 4)));
+    }
+    _mm_storeu_si128((__m128i *)total, acc);
+#else
+    total[0] = total[1] = total[2] = total[3] = 0;
+    for (int x = x0; x < x1; x++)
+    {
+        total[0] += sums[x * 4];
+        total[1] += sums[x * 4 + 1];
+        total[2] += sums[x * 4 + 2];
+        total[3] += sums[x * 4 + 3];
+    }
+#endif
+}
+
+// the most worker threads scaling an image, the calling thread helps too
+#define SCALE_MAX_THREADS 4
+// the fractional bits of the filter weights
+#define SCALE_PRECISION 14
+// images with fewer destination pixels are scaled on the calling thread alone
+#define SCALE_MIN_PARALLEL_PIXELS (64 * 1024)
+
+// ScaleCoefficients holds the fixed-point weights of a separable filter along one axis
+struct ScaleCoefficients
+{
+    // the number of weights per output pixel
+    int taps;
+    // the first input pixel and the number of input pixels of each output pixel
+    int *bounds;
+    // taps weights per output pixel, scaled by 1 << SCALE_PRECISION
+    Sint32 *weights;
+};
+
+// ScaleJob is one scaling operation, its bands of destination rows can run on any thread
+struct ScaleJob
+{
+    SDL_Surface *src;
+    SDL_Surface *dst;
+    enum ScaleQuality quality;
+    // the source columns covered by each destination column (box and nearest)
+    int *column_start;
+    int *column_end;
+    // 16.16 reciprocals of every possible pixel count (box)
+    Uint32 *reciprocals;
+    // the filter weights along each axis (bilinear and lanczos3)
+    struct ScaleCoefficients horizontal;
+    struct ScaleCoefficients vertical;
+    // the source rows filtered horizontally, 32-bit pixels dst->w wide (bilinear and lanczos3)
+    Uint8 *filtered;
+    int filtered_pitch;
+};
+
+// ScalePool runs the bands of a scaling job on a pool of worker threads and the calling thread
+struct ScalePool
+{
+    pthread_t threads[SCALE_MAX_THREADS];
+    int thread_count;
+    bool started;
+    // guards the fields below
+    pthread_mutex_t lock;
+    // signaled when there are bands to run
+    pthread_cond_t wake;
+    // signaled when the last band of a job is done
+    pthread_cond_t finished;
+    // held for the whole job, the main and prefetch threads both scale images
+    pthread_mutex_t job_lock;
+    // the job being run and how far it got
+    void (*band)(struct ScaleJob *job, int y0, int y1);
+    struct ScaleJob *job;
+    int rows;
+    int band_rows;
+    int next_row;
+    int running_bands;
+    bool quitting;
+} scale_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .finished = PTHREAD_COND_INITIALIZER,
+    .job_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// scale_pool_take runs bands of the current job until none are left
+// the caller holds the pool lock, which is released while a band runs
+void scale_pool_take(struct ScalePool *pool)
+{
+    while (pool->job != NULL && pool->next_row < pool->rows)
+    {
+        int y0 = pool->next_row;
+        int y1 = y0 + pool->band_rows < pool->rows ? y0 + pool->band_rows : pool->rows;
+        pool->next_row = y1;
+        pool->running_bands++;
+
+        struct ScaleJob *job = pool->job;
+        void (*band)(struct ScaleJob *, int, int) = pool->band;
+        pthread_mutex_unlock(&pool->lock);
+        band(job, y0, y1);
+        pthread_mutex_lock(&pool->lock);
+
+        pool->running_bands--;
+        if (pool->next_row >= pool->rows && pool->running_bands == 0)
+        {
+            pthread_cond_broadcast(&pool->finished);
+        }
+    }
+}
+
+// scale_pool_worker runs bands whenever a job is posted
+void *scale_pool_worker(void *arg)
+{
+    struct ScalePool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quitting)
+    {
+        if (pool->job == NULL || pool->next_row >= pool->rows)
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            continue;
+        }
+        scale_pool_take(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// scale_pool_start starts a worker for every core but the one of the calling thread
+void scale_pool_start(struct ScalePool *pool)
+{
+    pool->started = true;
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cores > 1 ? (int)cores - 1 : 0;
+    if (workers > SCALE_MAX_THREADS)
+    {
+        workers = SCALE_MAX_THREADS;
+    }
+
+    for (int i = 0; i < workers; i++)
+    {
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, scale_pool_worker, pool) != 0)
+        {
+            break;
+        }
+        pool->thread_count++;
+    }
+}
+
+// scale_pool_run splits the rows of a job into bands and returns once all of them are done
+void scale_pool_run(struct ScalePool *pool, void (*band)(struct ScaleJob *, int, int), struct ScaleJob *job, int rows)
+{
+    // small images are not worth waking the workers for
+    if ((long)rows * job->dst->w < SCALE_MIN_PARALLEL_PIXELS)
+    {
+        band(job, 0, rows);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->job_lock);
+    if (!pool->started)
+    {
+        scale_pool_start(pool);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->band = band;
+    pool->job = job;
+    pool->rows = rows;
+    pool->next_row = 0;
+    // a few bands per thread, so threads finishing early pick up the rest
+    int band_rows = rows / ((pool->thread_count + 1) * 4);
+    pool->band_rows = band_rows > 0 ? band_rows : 1;
+    pthread_cond_broadcast(&pool->wake);
+
+    scale_pool_take(pool);
+    while (pool->running_bands > 0)
+    {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pool->job = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->job_lock);
+}
+
+// scale_pool_stop stops the workers
+void scale_pool_stop(struct ScalePool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->quitting = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->thread_count = 0;
+}
+
+// scale_filter returns the weight of a filter at a distance from the sample center
+double scale_filter(enum ScaleQuality quality, double x)
+{
+    x = fabs(x);
+    if (quality == ScaleQualityBilinear)
+    {
+        return x < 1.0 ? 1.0 - x : 0.0;
+    }
+
+    // lanczos3: a sinc windowed by a wider sinc
+    if (x >= 3.0)
+    {
+        return 0.0;
+    }
+    if (x < 1e-8)
+    {
+        return 1.0;
+    }
+    double px = M_PI * x;
+    return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+}
+
+// scale_coefficients computes the weights of the input pixels contributing to each output pixel along an axis
+// when downscaling the filter is widened so it covers every input pixel
+bool scale_coefficients(struct ScaleCoefficients *coefficients, int in_size, int out_size, enum ScaleQuality quality)
+{
+    double support = quality == ScaleQualityBilinear ? 1.0 : 3.0;
+    double scale = (double)in_size / out_size;
+    double filter_scale = scale > 1.0 ? scale : 1.0;
+    double radius = support * filter_scale;
+
+    coefficients->taps = (int)ceil(radius) * 2 + 1;
+    coefficients->bounds = malloc(sizeof(int) * out_size * 2);
+    coefficients->weights = malloc(sizeof(Sint32) * out_size * coefficients->taps);
+    double *weights = malloc(sizeof(double) * coefficients->taps);
+    if (coefficients->bounds == NULL || coefficients->weights == NULL || weights == NULL)
+    {
+        free(weights);
+        return false;
+    }
+
+    for (int i = 0; i < out_size; i++)
+    {
+        double center = (i + 0.5) * scale;
+        int first = (int)(center - radius + 0.5);
+        int last = (int)(center + radius + 0.5);
+        first = first > 0 ? first : 0;
+        last = last < in_size ? last : in_size;
+        if (last - first > coefficients->taps)
+        {
+            last = first + coefficients->taps;
+        }
+
+        double total = 0.0;
+        for (int x = first; x < last; x++)
+        {
+            weights[x - first] = scale_filter(quality, (x - center + 0.5) / filter_scale);
+            total += weights[x - first];
+        }
+
+        Sint32 *fixed = coefficients->weights + i * coefficients->taps;
+        for (int x = 0; x < last - first; x++)
+        {
+            fixed[x] = (Sint32)lround(weights[x] / total * (1 << SCALE_PRECISION));
+        }
+        coefficients->bounds[i * 2] = first;
+        coefficients->bounds[i * 2 + 1] = last - first;
+    }
+
+    free(weights);
+    return true;
+}
+
+// scale_clamp converts a fixed-point filter sum back to a channel value
+Uint8 scale_clamp(Sint32 sum)
+{
+    sum = (sum + (1 << (SCALE_PRECISION - 1))) >> SCALE_PRECISION;
+    return sum < 0 ? 0 : (sum > 255 ? 255 : sum);
+}
+
+// scale_band_filter_horizontal filters source rows y0 to y1 horizontally into the filtered rows
+void scale_band_filter_horizontal(struct ScaleJob *job, int y0, int y1)
+{
+    struct ScaleCoefficients *coefficients = &job->horizontal;
+    for (int y = y0; y < y1; y++)
+    {
+        const Uint8 *src = (const Uint8 *)job->src->pixels + y * job->src->pitch;
+        Uint8 *dst = job->filtered + y * job->filtered_pitch;
+        for (int x = 0; x < job->dst->w; x++)
+        {
+            const Uint8 *pixels = src + coefficients->bounds[x * 2] * 4;
+            int count = coefficients->bounds[x * 2 + 1];
+            const Sint32 *weights = coefficients->weights + x * coefficients->taps;
+
+            Sint32 sum[4] = {0, 0, 0, 0};
+            for (int i = 0; i < count; i++)
+            {
+                sum[0] += pixels[i * 4] * weights[i];
+                sum[1] += pixels[i * 4 + 1] * weights[i];
+                sum[2] += pixels[i * 4 + 2] * weights[i];
+                sum[3] += pixels[i * 4 + 3] * weights[i];
+            }
+            for (int c = 0; c < 4; c++)
+            {
+                dst[x * 4 + c] = scale_clamp(sum[c]);
+            }
+        }
+    }
+}
+
+// scale_band_filter_vertical filters the filtered rows vertically into destination rows y0 to y1
+void scale_band_filter_vertical(struct ScaleJob *job, int y0, int y1)
+{
+    struct ScaleCoefficients *coefficients = &job->vertical;
+    int channels = job->dst->w * 4;
+    Sint32 *sums = malloc(sizeof(Sint32) * channels);
+    if (sums == NULL)
+    {
+        return;
+    }
+
+    for (int y = y0; y < y1; y++)
+    {
+        const Uint8 *src = job->filtered + coefficients->bounds[y * 2] * job->filtered_pitch;
+        int count = coefficients->bounds[y * 2 + 1];
+        const Sint32 *weights = coefficients->weights + y * coefficients->taps;
+
+        // add the weighted rows one after the other, reading them in memory order
+        memset(sums, 0, sizeof(Sint32) * channels);
+        for (int i = 0; i < count; i++)
+        {
+            const Uint8 *row = src + i * job->filtered_pitch;
+            Sint32 weight = weights[i];
+            for (int x = 0; x < channels; x++)
+            {
+                sums[x] += row[x] * weight;
+            }
+        }
+
+        Uint8 *dst = (Uint8 *)job->dst->pixels + y * job->dst->pitch;
+        for (int x = 0; x < channels; x++)
+        {
+            dst[x] = scale_clamp(sums[x]);
+        }
+    }
+
+    free(sums);
+}
+
+// scale_band_nearest copies the source pixel nearest to each pixel of destination rows y0 to y1
+void scale_band_nearest(struct ScaleJob *job, int y0, int y1)
+{
+    SDL_Surface *src = job->src;
+    SDL_Surface *dst = job->dst;
+    for (int y = y0; y < y1; y++)
+    {
+        int row = (int)(((Uint64)y * 2 + 1) * src->h / (dst->h * 2));
+        const Uint32 *src_row = (const Uint32 *)((const Uint8 *)src->pixels + row * src->pitch);
+        Uint32 *dst_row = (Uint32 *)((Uint8 *)dst->pixels + y * dst->pitch);
+        for (int x = 0; x < dst->w; x++)
+        {
+            dst_row[x] = src_row[job->column_start[x]];
+        }
+    }
+}
+
+// scale_band_box averages the source pixels covered by each pixel of destination rows y0 to y1
+// source rows are summed once per destination row, and the averages use fixed-point reciprocals
+void scale_band_box(struct ScaleJob *job, int y0, int y1)
+{
+    SDL_Surface *surface = job->src;
+    SDL_Surface *scaled = job->dst;
+    int bpp = surface->format->BytesPerPixel;
+    // 16-bit pixels are split into their four masked channels, other depths are averaged byte by byte
+    int channels = bpp == 2 ? 4 : bpp;
+    int src_w = surface->w;
+    int src_h = surface->h;
+    int height = scaled->h;
+
+    Uint32 *sums = malloc(sizeof(Uint32) * src_w * channels);
+    if (sums == NULL)
+    {
+        return;
+    }
+
+    for (int y = y0; y < y1; y++)
+    {
+        int row_start = (int)((Uint64)y * src_h / height);
+        int row_end = (int)((Uint64)(y + 1) * src_h / height);
+        if (row_end <= row_start)
+        {
+            row_end = row_start + 1;
+        }
+
+        // sum the covered source rows, column by column
+        memset(sums, 0, sizeof(Uint32) * src_w * channels);
+        for (int row = row_start; row < row_end; row++)
+        {
+            const Uint8 *src = (const Uint8 *)surface->pixels + row * surface->pitch;
+            if (bpp == 4)
+            {
+                scale_accumulate_row_32(sums, src, src_w);
+            }
+            else if (bpp == 2)
+            {
+                scale_accumulate_row_16(sums, src, src_w, surface->format);
+            }
+            else
+            {
+                scale_accumulate_row_bytes(sums, src, src_w, bpp);
+            }
+        }
+
+        // then average the covered columns of the row sums
+        Uint8 *dst = (Uint8 *)scaled->pixels + y * scaled->pitch;
+        for (int x = 0; x < scaled->w; x++)
+        {
+            int x0 = job->column_start[x];
+            int x1 = job->column_end[x];
+            Uint32 reciprocal = job->reciprocals[(x1 - x0) * (row_end - row_start)];
+
+            if (channels == 4)
+            {
+                Uint32 total[4];
+                scale_sum_columns(sums, x0, x1, total);
+                Uint32 average[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    average[c] = (total[c] * reciprocal + 32768) >> 16;
+                }
+
+                if (bpp == 4)
+                {
+                    for (int c = 0; c < 4; c++)
+                    {
+                        dst[x * 4 + c] = average[c] > 255 ? 255 : average[c];
+                    }
+                }
+                else
+                {
+                    SDL_PixelFormat *format = scaled->format;
+                    ((Uint16 *)dst)[x] = ((average[0] << format->Rshift) & format->Rmask) |
+                                         ((average[1] << format->Gshift) & format->Gmask) |
+                                         ((average[2] << format->Bshift) & format->Bmask) |
+                                         ((average[3] << format->Ashift) & format->Amask);
+                }
+            }
+            else
+            {
+                for (int c = 0; c < channels; c++)
+                {
+                    Uint32 total = 0;
+                    for (int column = x0; column < x1; column++)
+                    {
+                        total += sums[column * channels + c];
+                    }
+                    Uint32 average = (total * reciprocal + 32768) >> 16;
+                    dst[x * channels + c] = average > 255 ? 255 : average;
+                }
+            }
+        }
+    }
+
+    free(sums);
+}
+
+// scale_job_free releases the tables of a job
+void scale_job_free(struct ScaleJob *job)
+{
+    free(job->column_start);
+    free(job->reciprocals);
+    free(job->horizontal.bounds);
+    free(job->horizontal.weights);
+    free(job->vertical.bounds);
+    free(job->vertical.weights);
+    free(job->filtered);
+}
+
+// scale_surface scales a surface to a new width and height with the given quality
+// the destination rows are split into bands scaled in parallel by the scale pool
+// nearest, bilinear and lanczos3 need 32-bit pixels, other depths are always box filtered
+SDL_Surface *scale_surface(SDL_Surface *surface, Uint16 width, Uint16 height, enum ScaleQuality quality)
+{
+    SDL_Surface *scaled = SDL_CreateRGBSurface(surface->flags,
+                                               width,
+                                               height,
+                                               surface->format->BitsPerPixel,
+                                               surface->format->Rmask,
+                                               surface->format->Gmask,
+                                               surface->format->Bmask,
+                                               surface->format->Amask);
+    if (scaled == NULL || width == 0 || height == 0)
+    {
+        return scaled;
+    }
+
+    if (surface->format->BytesPerPixel != 4)
+    {
+        quality = ScaleQualityBox;
+    }
+
+    struct ScaleJob job = {.src = surface, .dst = scaled, .quality = quality};
+    bool ready = true;
+    if (quality == ScaleQualityBox || quality == ScaleQualityNearest)
+    {
+        job.column_start = malloc(sizeof(int) * width * 2);
+        ready = job.column_start != NULL;
+        if (ready)
+        {
+            job.column_end = job.column_start + width;
+            for (int x = 0; x < width; x++)
+            {
+                if (quality == ScaleQualityNearest)
+                {
+                    job.column_start[x] = (int)(((Uint64)x * 2 + 1) * surface->w / (width * 2));
+                    continue;
+                }
+                job.column_start[x] = (int)((Uint64)x * surface->w / width);
+                int end = (int)((Uint64)(x + 1) * surface->w / width);
+                job.column_end[x] = end > job.column_start[x] ? end : job.column_start[x] + 1;
+            }
+        }
+
+        if (ready && quality == ScaleQualityBox)
+        {
+            int max_count = (surface->w / width + 1) * (surface->h / height + 1);
+            job.reciprocals = malloc(sizeof(Uint32) * (max_count + 1));
+            ready = job.reciprocals != NULL;
+            for (int n = 1; ready && n <= max_count; n++)
+            {
+                job.reciprocals[n] = (65536 + n / 2) / n;
+            }
+        }
+    }
+    else
+    {
+        job.filtered_pitch = width * 4;
+        job.filtered = malloc((size_t)job.filtered_pitch * surface->h);
+        ready = job.filtered != NULL &&
+                scale_coefficients(&job.horizontal, surface->w, width, quality) &&
+                scale_coefficients(&job.vertical, surface->h, height, quality);
+    }
+
+    if (!ready)
+    {
+        scale_job_free(&job);
+        SDL_FreeSurface(scaled);
+        return NULL;
+    }
+
+    SDL_LockSurface(surface);
+    SDL_LockSurface(scaled);
+    if (quality == ScaleQualityNearest)
+    {
+        scale_pool_run(&scale_pool, scale_band_nearest, &job, height);
+    }
+    else if (quality == ScaleQualityBox)
+    {
+        scale_pool_run(&scale_pool, scale_band_box, &job, height);
+    }
+    else
+    {
+        // every source row is filtered horizontally before any destination row is filtered vertically
+        scale_pool_run(&scale_pool, scale_band_filter_horizontal, &job, surface->h);
+        scale_pool_run(&scale_pool, scale_band_filter_vertical, &job, height);
+    }
+    SDL_UnlockSurface(scaled);
+    SDL_UnlockSurface(surface);
+
+    scale_job_free(&job);
+    return scaled;
+}
@@ -0,0 +1,31 @@
+#ifndef IMAGE_SCALE_H
+#define IMAGE_SCALE_H
+
+#include <stdbool.h>
+#ifdef USE_SDL2
+#include <SDL2/SDL.h>
+#else
+#include <SDL/SDL.h>
+#endif
+
+// the filters a background image can be scaled with
+enum ScaleQuality
+{
+    ScaleQualityNearest,
+    ScaleQualityBilinear,
+    ScaleQualityBox,
+    ScaleQualityLanczos3,
+};
+
+// ScalePool runs the bands of a scaling job on worker threads, started by the first large image
+struct ScalePool;
+extern struct ScalePool scale_pool;
+
+// scale_surface scales a surface to a new width and height with the given quality
+// nearest, bilinear and lanczos3 need 32-bit pixels, other depths are always box filtered
+SDL_Surface *scale_surface(SDL_Surface *surface, Uint16 width, Uint16 height, enum ScaleQuality quality);
+
+// scale_pool_stop stops the workers
+void scale_pool_stop(struct ScalePool *pool);
+
+#endif
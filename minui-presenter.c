@@ -1,13 +1,20 @@
 #include <fcntl.h>
 #include <getopt.h>
+#include <math.h>
 #include <msettings.h>
 #include <parson/parson.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
-#include <sys/time.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef USE_SDL2
 #include <SDL2/SDL_ttf.h>
@@ -20,6 +27,16 @@
 #include "defines.h"
 #include "api.h"
 #include "utils.h"
+#include "image_scale.h"
+
+// oversized JPEG and PNG backgrounds are decoded straight to a reduced size when the libraries are available
+#ifdef HAS_LIBJPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+#ifdef HAS_LIBPNG
+#include <png.h>
+#endif
 
 // Structure to manage text scrolling
 struct ScrollState
@@ -29,6 +46,16 @@ struct ScrollState
     int viewport_height;   // Visible height
     bool needs_scroll;     // Indicates if the content needs scrolling
     bool scroll_to_bottom; // Indicates if we should scroll to the bottom of the text
+
+    // Smooth scrolling, scroll_position is the rounded value of position
+    float position;        // Exact scroll position (in pixels)
+    float velocity;        // Scroll speed (in pixels per second)
+    int direction;         // Held direction: -1 up, 1 down, 0 none
+    float held;            // How long the direction has been held (in seconds)
+    float target;          // Where a page jump is heading
+    bool has_target;       // Indicates if a page jump is in progress
+    Uint32 last_tick;      // Time of the last animation update (SDL_GetTicks)
+    float accumulator;     // Time not simulated yet (in milliseconds)
 };
 
 // Function prototypes
@@ -41,6 +68,16 @@ void print_help(const char *program_name);
 #define SCROLLBAR_PADDING SCALE1(2)     // Padding between the scrollbar and the edge of the screen
 #define SCROLLBAR_MIN_HEIGHT SCALE1(20) // Minimum height of the scrollbar thumb
 
+// Constants for smooth scrolling
+#define SCROLL_STEP_MS (1000.0f / 60)      // Fixed animation timestep
+#define SCROLL_MAX_STEPS 4                 // Steps simulated at most per frame, the rest is dropped
+#define SCROLL_BASE_SPEED SCALE1(240)      // Speed when a direction is pressed (pixels per second)
+#define SCROLL_ACCELERATION SCALE1(1200)   // Speed gained per second while held
+#define SCROLL_MAX_SPEED SCALE1(2400)      // Speed cap while held
+#define SCROLL_FRICTION 0.85f              // Speed kept per step after release
+#define SCROLL_MIN_SPEED SCALE1(10)        // Below this speed a glide stops
+#define SCROLL_PAGE_EASING 0.25f           // Share of the remaining distance covered per step of a page jump
+
 SDL_Surface *screen = NULL;
 
 #ifdef USE_SDL2
@@ -86,6 +123,22 @@ void log_info(const char *msg)
     printf("%s\n", msg);
 }
 
+#ifdef DEBUG
+// log_memory_usage logs the peak resident set size of the process to stderr
+void log_memory_usage(const char *label)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return;
+    }
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s: peak RSS %ld KB", label, usage.ru_maxrss);
+    log_error(buffer);
+}
+#endif
+
 // Fonts holds the fonts for the list
 struct Fonts
 {
@@ -116,14 +169,104 @@ enum HorizontalAlignment
     HorizontalAlignmentRight,
 };
 
+// the size of the first block of an arena
+#define ARENA_BLOCK_SIZE (16 * 1024)
+// the alignment of every allocation from an arena
+#define ARENA_ALIGNMENT 16
+
+// ArenaBlock is a chunk of memory handed out by an Arena
+struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    // aligned so records of any type can be placed at the start of the block
+    char data[] __attribute__((aligned(ARENA_ALIGNMENT)));
+};
+
+// Arena hands out memory from large blocks that are all released at once
+struct Arena
+{
+    // the block memory is currently handed out from
+    struct ArenaBlock *head;
+};
+
+// Message holds a wrapped line of an item's text as a span of the layout text
+struct Message
+{
+    size_t offset; // Offset of the first byte of the line in the layout text
+    size_t length; // Length of the line in bytes
+    int width;
+    int y; // Offset of the line from the top of the layout
+};
+
+// TextLayout holds the wrapped lines of an item's text
+// every record of the layout is allocated from its arena
+struct TextLayout
+{
+    // the memory the layout is allocated from, reset when the layout is recomputed
+    struct Arena arena;
+    // whether the layout has been computed
+    bool valid;
+    // the font the layout was computed with
+    TTF_Font *font;
+    // the font size the layout was computed with
+    int font_size;
+    // the maximum width of a line
+    int wrap_width;
+    // the line spacing the layout was computed with
+    int line_spacing;
+    // the line limit the layout was computed with
+    int max_lines;
+    // the text of the item with its whitespace collapsed, the lines point into it
+    char *text;
+    // the wrapped lines
+    struct Message *lines;
+    // the number of wrapped lines
+    int line_count;
+    // the height of a single line
+    int line_height;
+    // the height of all lines including the line spacing
+    int height;
+    // the rendered surface of each line (NULL when not rendered yet)
+    SDL_Surface **line_surfaces;
+    // the number of bytes used by the rendered line surfaces
+    size_t surface_bytes;
+};
+
+// the memory cap for the rendered line surfaces of a single layout
+#define LINE_SURFACE_CACHE_BYTES (8 * 1024 * 1024)
+
+// StringTableEntry is a string held by a StringTable
+struct StringTableEntry
+{
+    // the string (NULL when the slot is empty)
+    char *string;
+    // whether the string was checked for as a file path by items_compile, and whether the file exists
+    bool checked;
+    bool exists;
+};
+
+// StringTable holds one copy of each distinct string, looked up by hash
+struct StringTable
+{
+    // the slots (the capacity is a power of two)
+    struct StringTableEntry *entries;
+    size_t capacity;
+    // the number of strings held
+    size_t count;
+};
+
 struct Item
 {
-    // the background color to use for the list
-    char *background_color;
-    // path to the background image to use for the list
-    char *background_image;
-    // whether the background image exists
+    // the background color to use for the list (interned, see ItemsState)
+    const char *background_color;
+    // path to the background image to use for the list (interned, see ItemsState)
+    const char *background_image;
+    // whether the background image exists (checked once per distinct path by items_compile)
     bool image_exists;
+    // the inotify watch on the directory of the background image (-1 when not watched)
+    int watch;
     // the text to display
     char *text;
     // whether to show a pill around the text or not
@@ -134,6 +277,176 @@ struct Item
     enum HorizontalAlignment horizontal_alignment;
     // the spacing between lines (in pixels, scaled by SCALE1)
     int line_spacing;
+    // the maximum number of lines shown, the last one ends with an ellipsis (0 for no limit)
+    int max_lines;
+    // the filter used to scale the background image
+    enum ScaleQuality scale_quality;
+    // the cached wrapped lines of the text
+    struct TextLayout layout;
+    // whether the background is filled before drawing (set by items_compile)
+    bool fills_background;
+    // the background color mapped to the screen format (set by items_compile)
+    Uint32 background_pixel;
+};
+
+// DecodedImage is a background image prepared for the screen, before it is cached
+struct DecodedImage
+{
+    // the prepared image
+    SDL_Surface *surface;
+    // where the surface should be blitted on the screen
+    SDL_Rect dst;
+    // the disk cache file the pixels are mapped from (NULL when they were decoded)
+    void *mapping;
+    size_t mapping_size;
+};
+
+// ImageCacheEntry holds a decoded background image that is ready to be blitted
+struct ImageCacheEntry
+{
+    // the path to the source image
+    char *path;
+    // the modification time of the source image when it was decoded
+    time_t mtime;
+    // the size of the area the image was fitted into
+    int target_w;
+    int target_h;
+    // the filter the image was scaled with
+    enum ScaleQuality quality;
+    // the decoded image, converted to the screen format and scaled to dst
+    SDL_Surface *surface;
+    // where the surface should be blitted on the screen
+    SDL_Rect dst;
+    // the disk cache file the surface pixels are mapped from (NULL when they were decoded)
+    void *mapping;
+    size_t mapping_size;
+    // the number of bytes used by the surface pixels
+    size_t bytes;
+    // the previous (more recently used) entry
+    struct ImageCacheEntry *prev;
+    // the next (less recently used) entry
+    struct ImageCacheEntry *next;
+};
+
+// ImageCache holds decoded background images in least-recently-used order
+struct ImageCache
+{
+    // the most recently used entry
+    struct ImageCacheEntry *head;
+    // the least recently used entry
+    struct ImageCacheEntry *tail;
+    // the number of bytes used by all entries
+    size_t bytes;
+    // the maximum number of bytes to keep before evicting entries
+    size_t max_bytes;
+    // the entry being drawn, it is never evicted
+    struct ImageCacheEntry *in_use;
+    // the entry on screen while another frame is composed offscreen, it is never evicted either
+    struct ImageCacheEntry *pinned;
+    // the path the prefetch worker is decoding (NULL when idle)
+    const char *decoding;
+    // guards the cache, which the prefetch worker fills
+    pthread_mutex_t lock;
+    // signaled when the prefetch worker is done decoding a path
+    pthread_cond_t decoded;
+    // incremented whenever a decoded image is added, so a placeholder can be replaced once its image is ready
+    unsigned int insertions;
+    // where prepared images are kept between runs (empty when disabled), set before the prefetch worker starts
+    char disk_cache_dir[1024];
+};
+
+// Prefetcher decodes the background images of the items around the selected one on a worker thread
+struct Prefetcher
+{
+    pthread_t thread;
+    bool running;
+    // guards the request fields below
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    // the item to prefetch around and the direction the user navigates in
+    int selected;
+    int direction;
+    // incremented for every request, the worker drops work for older requests
+    unsigned int generation;
+    // the last request the worker completed
+    unsigned int completed;
+    bool quitting;
+    // the number of items ahead of the selected one to decode (0 disables prefetching)
+    int depth;
+    // the selected item of the last request, only used by the main thread
+    int requested;
+    // what the worker decodes and where it stores the result
+    struct ItemsState *items_state;
+    struct ImageCache *cache;
+    bool no_wrap;
+};
+
+// the default number of items ahead of the selected one to prefetch
+#define PREFETCH_DEFAULT_DEPTH 1
+// the most items ahead that can be prefetched, the image cache size bounds what is kept anyway
+#define PREFETCH_MAX_DEPTH 16
+
+// ImageWatchDirectory is a watched directory and the items whose background image is in it
+struct ImageWatchDirectory
+{
+    // the watch descriptor of the directory
+    int wd;
+    // the items and the file names of their images
+    int count;
+    int *items;
+    const char **names;
+};
+
+// ImageWatch watches the directories of the background images, so images that appear
+// or are rewritten are shown without checking the files every frame
+struct ImageWatch
+{
+    // the inotify instance (-1 when unavailable)
+    int fd;
+    // the watched directories
+    int count;
+    struct ImageWatchDirectory *directories;
+};
+
+// the default memory cap for the image cache (in megabytes)
+#define IMAGE_CACHE_DEFAULT_SIZE_MB 32
+// the largest image cache size, the devices have far less memory and larger sizes overflow a 32-bit size_t
+#define IMAGE_CACHE_MAX_SIZE_MB 1024
+
+// identifies a disk cache file ("MPIC") and the layout of its header
+#define DISK_CACHE_MAGIC 0x4349504d
+#define DISK_CACHE_VERSION 1
+// the alignment of the pixels in a disk cache file
+#define DISK_CACHE_PIXELS_ALIGN 64
+
+// DiskCacheHeader starts every disk cache file, it is followed by the source path and the pixels
+struct DiskCacheHeader
+{
+    Uint32 magic;
+    Uint32 version;
+    // the source image the pixels were prepared from
+    int64_t mtime;
+    int64_t size;
+    Uint32 path_length;
+    // how the pixels were prepared
+    Sint32 target_w;
+    Sint32 target_h;
+    Sint32 quality;
+    // the screen format the image was prepared for
+    Uint32 screen_bpp;
+    Uint32 screen_masks[4];
+    // the format of the pixels and whether they are alpha blended
+    Uint32 bpp;
+    Uint32 masks[4];
+    Uint32 alpha;
+    // where the image is drawn
+    Sint32 dst_x;
+    Sint32 dst_y;
+    Sint32 width;
+    Sint32 height;
+    Sint32 pitch;
+    // the offset of the pixels from the start of the file
+    Uint32 pixels_offset;
 };
 
 // ItemsState holds the state of the list
@@ -145,6 +458,73 @@ struct ItemsState
     size_t item_count;
     // index of currently selected item
     int selected;
+    // the direction of the last navigation (1 forward, -1 backward)
+    int direction;
+    // the memory of the items and their strings
+    struct Arena arena;
+    // the distinct colors and paths of the items, each held once in the arena
+    struct StringTable strings;
+};
+
+// the number of rectangles tracked before damage is widened to the whole screen
+#define MAX_DAMAGE_RECTS 8
+
+// Damage holds the parts of the screen that changed
+struct Damage
+{
+    // whether the whole screen changed
+    bool full;
+    // the changed rectangles, they never overlap each other
+    SDL_Rect rects[MAX_DAMAGE_RECTS];
+    int count;
+};
+
+// DrawnFrame holds what the screen showed after the last draw
+struct DrawnFrame
+{
+    // whether the screen still shows the last draw
+    bool valid;
+    // the item and layout that were drawn
+    struct Item *item;
+    struct TextLayout *layout;
+    // the height taken by the time left label
+    int initial_padding;
+    // the y position of the first line
+    int lines_y;
+    // the pixels the frame was drawn into
+    void *pixels;
+};
+
+// Countdown holds the time left label, formatted again only when the seconds change
+struct Countdown
+{
+    // the seconds shown by the label (-1 until the first update)
+    int shown;
+    // the label text
+    char label[64];
+    // the width of the label on screen
+    int width;
+};
+
+// Prerender holds the next item, composed offscreen while the presenter is idle
+struct Prerender
+{
+    // the composed frame, in the screen format
+    SDL_Surface *surface;
+    // whether the surface holds a complete frame of the item
+    bool valid;
+    // the composed item (-1 when none)
+    int item;
+    // whether composing the item failed, it is not tried again until another item is next
+    bool failed;
+    // the state the item was composed with
+    int scroll_position;
+    bool scroll_to_bottom;
+    bool image_exists;
+    int countdown_shown;
+    // whether the frame was composed before its background image was decoded
+    bool image_pending;
+    unsigned int image_insertions;
 };
 
 // AppState holds the current state of the application
@@ -202,25 +582,87 @@ struct AppState
     int timeout_seconds;
     // the key to the items array in the JSON file
     char item_key[1024];
-    // the start time of the presentation
-    struct timeval start_time;
+    // the start time of the presentation in milliseconds (monotonic clock)
+    unsigned long start_time;
+    // the time left label
+    struct Countdown countdown;
     // the fonts to use for the list
     struct Fonts fonts;
     // the display states
     struct ItemsState *items_state;
     struct ScrollState scroll_state;
+    // the decoded background images
+    struct ImageCache image_cache;
+    // decodes the images of the neighbouring items ahead of time
+    struct Prefetcher prefetcher;
+    // reports background images that appear or change
+    struct ImageWatch image_watch;
+    // the next item, composed ahead of time
+    struct Prerender prerender;
+    // the item drawn with a placeholder while the prefetch worker decodes its image (NULL when none)
+    struct Item *image_pending;
+    // the number of images the cache had received when the placeholder was drawn
+    unsigned int image_insertions;
+    // what the screen showed after the last draw
+    struct DrawnFrame drawn;
+    // the regions widgets changed, drawn again on the next frame
+    struct Damage damage;
+    // the regions of the screen changed since the last flip
+    struct Damage flip_damage;
+    // whether flipping the screen moves its pixels (e.g. double buffering),
+    // in which case the previous frame cannot be reused
+    bool framebuffer_moves;
 };
 
-#define MAX_MESSAGES 512
+// Frame holds where everything is drawn for the current state
+struct Frame
+{
+    // the selected item
+    struct Item *item;
+    // the wrapped lines of the selected item
+    struct TextLayout *layout;
+    // the time left label (NULL when not shown)
+    const char *time_left;
+    // the height taken by the time left label
+    int initial_padding;
+    // the top of the area the text scrolls in
+    int viewport_top;
+    // the y position of the first line
+    int lines_y;
+    // the lines intersecting the viewport
+    int first_visible;
+    int last_visible;
+    // whether the background image was not decoded yet and the background color was drawn in its place
+    bool image_pending;
+    // the number of images the cache had received before the image was looked up
+    unsigned int image_insertions;
+    // the background image, looked up by the first region drawn (NULL when it is not ready)
+    struct ImageCacheEntry *image;
+    bool image_looked_up;
+};
 
 // Animation spinner
-#define SPINNER_FRAMES 4
-const char *SPINNER_CHARS[SPINNER_FRAMES] = {"|", "/", "-", "\\"};
+#define SPINNER_SIZE 20
+#define SPINNER_DEFAULT_FPS 10
+#define SPINNER_ARC_FRAMES 12
+// the frames of the character spinner styles
+const char *SPINNER_LINE_FRAMES[] = {"|", "/", "-", "\\", NULL};
+const char *SPINNER_DOTS_FRAMES[] = {".  ", ".. ", "...", " ..", "  .", "   ", NULL};
 struct Spinner
 {
     bool active;
+    // line, dots, arc or the path to a PNG strip of square frames
+    char style[1024];
+    // the frames shown per second
+    int fps;
+    // the frames rasterized side by side once at startup
+    SDL_Surface *sheet;
+    int frame_count;
+    int frame_width;
+    int frame_height;
+    // the frame on screen and when the animation started
     int current_frame;
-    unsigned long last_update;
+    unsigned long start_time;
     int x;
     int y;
     // Save the position of the last message for the spinner
@@ -228,6 +670,11 @@ struct Spinner
     int last_message_width;
     int last_message_y;
     int last_message_height;
+    // where the spinner was last drawn (w is 0 when it was not drawn)
+    SDL_Rect drawn;
+    // the screen pixels under the drawn spinner, in the screen format
+    SDL_Surface *background;
+    bool background_saved;
 };
 
 // Global options
@@ -239,8 +686,13 @@ struct GlobalOptions
     .preserve_framebuffer = false,
     .spinner = {
         .active = false,
+        .style = "line",
+        .fps = SPINNER_DEFAULT_FPS,
+        .sheet = NULL,
+        .background = NULL,
+        .background_saved = false,
         .current_frame = 0,
-        .last_update = 0,
+        .start_time = 0,
         .x = 0,
         .y = 0,
         .last_message_x = 0,
@@ -248,13 +700,6 @@ struct GlobalOptions
         .last_message_y = 0,
         .last_message_height = 0}};
 
-struct Message
-{
-    char message[1024];
-    int width;
-    bool is_newline; // Indicates if this word starts a new line (after a \n)
-};
-
 void strtrim(char *s)
 {
     if (!s)
@@ -343,12 +788,247 @@ char *read_stdin()
     return stdin_contents;
 }
 
+// arena_alloc returns size bytes from the arena, adding a block when the current one is full
+// returns NULL if memory cannot be allocated
+void *arena_alloc(struct Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    struct ArenaBlock *block = arena->head;
+    if (block == NULL || block->used + size > block->size)
+    {
+        size_t block_size = ARENA_BLOCK_SIZE;
+        if (block != NULL && block->size * 2 > block_size)
+        {
+            // grow geometrically so large documents need few blocks
+            block_size = block->size * 2;
+        }
+        if (size > block_size)
+        {
+            block_size = size;
+        }
+
+        block = malloc(sizeof(struct ArenaBlock) + block_size);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+// arena_reset releases everything allocated from the arena
+// the largest block is kept so the arena can be refilled without allocating
+void arena_reset(struct Arena *arena)
+{
+    struct ArenaBlock *largest = NULL;
+    struct ArenaBlock *block = arena->head;
+    while (block != NULL)
+    {
+        struct ArenaBlock *next = block->next;
+        if (largest == NULL || block->size > largest->size)
+        {
+            free(largest);
+            largest = block;
+        }
+        else
+        {
+            free(block);
+        }
+        block = next;
+    }
+
+    if (largest != NULL)
+    {
+        largest->used = 0;
+        largest->next = NULL;
+    }
+    arena->head = largest;
+}
+
+// arena_free releases the arena and all of its blocks
+void arena_free(struct Arena *arena)
+{
+    while (arena->head != NULL)
+    {
+        struct ArenaBlock *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+// arena_strdup copies a string into the arena
+// returns NULL if memory runs out
+char *arena_strdup(struct Arena *arena, const char *string)
+{
+    size_t length = strlen(string) + 1;
+    char *copy = arena_alloc(arena, length);
+    if (copy != NULL)
+    {
+        memcpy(copy, string, length);
+    }
+    return copy;
+}
+
+// parse_scale_quality converts a scale quality name (nearest, bilinear, box or lanczos3)
+// returns false if the name is unknown
+bool parse_scale_quality(const char *name, enum ScaleQuality *quality)
+{
+    if (strcmp(name, "nearest") == 0)
+    {
+        *quality = ScaleQualityNearest;
+    }
+    else if (strcmp(name, "bilinear") == 0)
+    {
+        *quality = ScaleQualityBilinear;
+    }
+    else if (strcmp(name, "box") == 0)
+    {
+        *quality = ScaleQualityBox;
+    }
+    else if (strcmp(name, "lanczos3") == 0)
+    {
+        *quality = ScaleQualityLanczos3;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// string_hash hashes a string with 32-bit FNV-1a
+Uint32 string_hash(const char *string)
+{
+    Uint32 hash = 2166136261u;
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        hash = (hash ^ (Uint8)*c) * 16777619u;
+    }
+    return hash;
+}
+
+// string_table_find returns the entry holding a string, or NULL if the table does not hold it
+struct StringTableEntry *string_table_find(struct StringTable *table, const char *string)
+{
+    if (table->capacity == 0)
+    {
+        return NULL;
+    }
+
+    size_t slot = string_hash(string) & (table->capacity - 1);
+    while (table->entries[slot].string != NULL)
+    {
+        if (strcmp(table->entries[slot].string, string) == 0)
+        {
+            return &table->entries[slot];
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return NULL;
+}
+
+// string_table_intern returns the copy of a string held by the table, adding one to the arena if there is none
+// the table grows to twice the strings it holds, so lookups stay short
+// returns NULL if memory runs out
+const char *string_table_intern(struct StringTable *table, struct Arena *arena, const char *string)
+{
+    if (2 * (table->count + 1) > table->capacity)
+    {
+        size_t capacity = table->capacity > 0 ? 2 * table->capacity : 64;
+        struct StringTableEntry *entries = calloc(capacity, sizeof(struct StringTableEntry));
+        if (entries == NULL)
+        {
+            return NULL;
+        }
+
+        // rehash the held strings into the larger table
+        struct StringTable grown = {entries, capacity, table->count};
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            if (table->entries[i].string == NULL)
+            {
+                continue;
+            }
+
+            size_t slot = string_hash(table->entries[i].string) & (capacity - 1);
+            while (entries[slot].string != NULL)
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            entries[slot] = table->entries[i];
+        }
+
+        free(table->entries);
+        *table = grown;
+    }
+
+    // linear probing from the slot the string hashes to
+    size_t slot = string_hash(string) & (table->capacity - 1);
+    while (table->entries[slot].string != NULL)
+    {
+        if (strcmp(table->entries[slot].string, string) == 0)
+        {
+            return table->entries[slot].string;
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    table->entries[slot].string = arena_strdup(arena, string);
+    if (table->entries[slot].string == NULL)
+    {
+        return NULL;
+    }
+    table->count++;
+    return table->entries[slot].string;
+}
+
+// ItemsState_Alloc creates a list of zeroed items, allocated with their strings from one arena
+// returns NULL if memory runs out
+struct ItemsState *ItemsState_Alloc(size_t item_count)
+{
+    struct ItemsState *state = calloc(1, sizeof(struct ItemsState));
+    if (state == NULL)
+    {
+        return NULL;
+    }
+
+    state->items = arena_alloc(&state->arena, item_count * sizeof(struct Item));
+    if (state->items == NULL)
+    {
+        free(state);
+        return NULL;
+    }
+    memset(state->items, 0, item_count * sizeof(struct Item));
+
+    state->item_count = item_count;
+    state->selected = 0;
+    state->direction = 1;
+    return state;
+}
+
+// ItemsState_Free frees a list with its items and their strings, block by block
+// the text layouts are not part of the arena and must be freed first
+void ItemsState_Free(struct ItemsState *state)
+{
+    arena_free(&state->arena);
+    free(state->strings.entries);
+    free(state);
+}
+
 // hydrate_display_states hydrates the display states from a file or stdin
-struct ItemsState *ItemsState_New(const char *filename, const char *item_key, const char *default_background_image, const char *default_background_color, bool default_show_pill, enum MessageAlignment default_alignment)
+struct ItemsState *ItemsState_New(const char *filename, const char *item_key, const char *default_background_image, const char *default_background_color, bool default_show_pill, enum MessageAlignment default_alignment, enum ScaleQuality default_scale_quality)
 {
-    struct ItemsState *state = malloc(sizeof(struct ItemsState));
     enum HorizontalAlignment default_horizontal_alignment = HorizontalAlignmentCenter;
     int default_line_spacing = PADDING; // default line spacing
+    int default_max_lines = 0;          // no line limit
 
     JSON_Value *root_value;
     if (strcmp(filename, "-") == 0)
@@ -395,7 +1075,24 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
         return NULL;
     }
 
-    state->items = malloc(sizeof(struct Item) * item_count);
+    struct ItemsState *state = ItemsState_Alloc(item_count);
+    if (state == NULL)
+    {
+        log_error("Failed to allocate the items");
+        json_value_free(root_value);
+        return NULL;
+    }
+
+    // the defaults are shared by every item that does not set its own
+    default_background_image = string_table_intern(&state->strings, &state->arena, default_background_image);
+    default_background_color = string_table_intern(&state->strings, &state->arena, default_background_color);
+    if (default_background_image == NULL || default_background_color == NULL)
+    {
+        log_error("Failed to allocate the items");
+        ItemsState_Free(state);
+        json_value_free(root_value);
+        return NULL;
+    }
 
     for (size_t i = 0; i < item_count; i++)
     {
@@ -405,6 +1102,7 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
             char buff[1024];
             snprintf(buff, sizeof(buff), "Failed to get item %zu", i);
             log_error(buff);
+            ItemsState_Free(state);
             json_value_free(root_value);
             return NULL;
         }
@@ -415,28 +1113,33 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
             char buff[1024];
             snprintf(buff, sizeof(buff), "Failed to get text for item %zu", i);
             log_error(buff);
+            ItemsState_Free(state);
             json_value_free(root_value);
             return NULL;
         }
 
-        state->items[i].text = strdup(text);
+        state->items[i].text = arena_strdup(&state->arena, text);
 
         const char *background_image = json_object_get_string(item, "background_image");
-        state->items[i].background_image = strdup(default_background_image);
-        state->items[i].image_exists = default_background_image != NULL && access(default_background_image, F_OK) != -1;
+        state->items[i].background_image = default_background_image;
         if (background_image != NULL)
         {
-            char *temp = strdup(background_image);
-            free(state->items[i].background_image); // Free previous allocation
-            state->items[i].background_image = temp;
-            state->items[i].image_exists = access(background_image, F_OK) != -1;
+            state->items[i].background_image = string_table_intern(&state->strings, &state->arena, background_image);
         }
 
         const char *background_color = json_object_get_string(item, "background_color");
-        state->items[i].background_color = strdup(default_background_color);
+        state->items[i].background_color = default_background_color;
         if (background_color != NULL)
         {
-            state->items[i].background_color = strdup(background_color);
+            state->items[i].background_color = string_table_intern(&state->strings, &state->arena, background_color);
+        }
+
+        if (state->items[i].text == NULL || state->items[i].background_image == NULL || state->items[i].background_color == NULL)
+        {
+            log_error("Failed to allocate the items");
+            ItemsState_Free(state);
+            json_value_free(root_value);
+            return NULL;
         }
 
         state->items[i].show_pill = default_show_pill;
@@ -455,6 +1158,7 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
                 char buff[1024];
                 snprintf(buff, sizeof(buff), "Invalid show_pill value provided for item %zu", i);
                 log_error(buff);
+                ItemsState_Free(state);
                 json_value_free(root_value);
                 return NULL;
             }
@@ -482,6 +1186,7 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
             char buff[1024];
             snprintf(buff, sizeof(buff), "Invalid alignment provided for item %zu", i);
             log_error(buff);
+            ItemsState_Free(state);
             json_value_free(root_value);
             return NULL;
         }
@@ -509,6 +1214,7 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
                     char buff[1024];
                     snprintf(buff, sizeof(buff), "Invalid horizontal_alignment provided for item %zu", i);
                     log_error(buff);
+                    ItemsState_Free(state);
                     json_value_free(root_value);
                     return NULL;
                 }
@@ -529,14 +1235,45 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
                 char buff[1024];
                 snprintf(buff, sizeof(buff), "Invalid line_spacing value provided for item %zu", i);
                 log_error(buff);
+                ItemsState_Free(state);
                 json_value_free(root_value);
                 return NULL;
             }
         }
-    }
 
-    state->item_count = item_count;
-    state->selected = 0;
+        // Set the line limit
+        state->items[i].max_lines = default_max_lines;
+        if (json_object_has_value(item, "max_lines"))
+        {
+            int max_lines = (int)json_object_get_number(item, "max_lines");
+            if (max_lines >= 0)
+            {
+                state->items[i].max_lines = max_lines;
+            }
+            else
+            {
+                char buff[1024];
+                snprintf(buff, sizeof(buff), "Invalid max_lines value provided for item %zu", i);
+                log_error(buff);
+                ItemsState_Free(state);
+                json_value_free(root_value);
+                return NULL;
+            }
+        }
+
+        // Set the filter the background image is scaled with
+        state->items[i].scale_quality = default_scale_quality;
+        const char *scale_quality = json_object_get_string(item, "scale_quality");
+        if (scale_quality != NULL && !parse_scale_quality(scale_quality, &state->items[i].scale_quality))
+        {
+            char buff[1024];
+            snprintf(buff, sizeof(buff), "Invalid scale_quality provided for item %zu", i);
+            log_error(buff);
+            ItemsState_Free(state);
+            json_value_free(root_value);
+            return NULL;
+        }
+    }
 
     if (json_object_has_value(root_object, "selected"))
     {
@@ -555,32 +1292,120 @@ struct ItemsState *ItemsState_New(const char *filename, const char *item_key, co
     return state;
 }
 
-// handle_input interprets input events and mutates app state
-void handle_input(struct AppState *state)
+// scroll_step advances the scroll animation by one fixed timestep
+void scroll_step(struct ScrollState *scroll_state, float max_scroll)
 {
-    if (!state->items_state->items[state->items_state->selected].image_exists && state->items_state->items[state->items_state->selected].background_image != NULL)
+    float dt = SCROLL_STEP_MS / 1000;
+    if (scroll_state->direction != 0)
     {
-        if (access(state->items_state->items[state->items_state->selected].background_image, F_OK) != -1)
+        // accelerate while a direction is held
+        scroll_state->held += dt;
+        float speed = SCROLL_BASE_SPEED + SCROLL_ACCELERATION * scroll_state->held;
+        if (speed > SCROLL_MAX_SPEED)
         {
-            state->items_state->items[state->items_state->selected].image_exists = true;
-            state->redraw = 1;
+            speed = SCROLL_MAX_SPEED;
         }
+        scroll_state->velocity = scroll_state->direction * speed;
+        scroll_state->has_target = false;
     }
-
-    if (state->timeout_seconds < 0)
+    else if (scroll_state->has_target)
     {
-        return;
+        // ease towards the page jump target
+        float remaining = scroll_state->target - scroll_state->position;
+        scroll_state->velocity = 0;
+        if (remaining > -0.5f && remaining < 0.5f)
+        {
+            scroll_state->position = scroll_state->target;
+            scroll_state->has_target = false;
+        }
+        else
+        {
+            scroll_state->position += remaining * SCROLL_PAGE_EASING;
+        }
     }
-
-    if (increment_item_list_index)
+    else
     {
-        pthread_mutex_lock(&increment_item_list_index_lock);
-        increment_item_list_index = 0;
-        state->items_state->selected += 1;
-        bool should_return = false;
-        if (state->items_state->selected >= state->items_state->item_count)
+        // glide to a stop after release
+        scroll_state->velocity *= SCROLL_FRICTION;
+        if (scroll_state->velocity > -SCROLL_MIN_SPEED && scroll_state->velocity < SCROLL_MIN_SPEED)
         {
-            if (state->quit_after_last_item)
+            scroll_state->velocity = 0;
+        }
+    }
+
+    scroll_state->position += scroll_state->velocity * dt;
+    if (scroll_state->position < 0 || scroll_state->position > max_scroll)
+    {
+        scroll_state->position = scroll_state->position < 0 ? 0 : max_scroll;
+        scroll_state->velocity = 0;
+    }
+}
+
+// scroll_animate runs the scroll animation up to the current time on a fixed timestep
+// when a frame overran, the steps it missed past SCROLL_MAX_STEPS are dropped instead of queued
+void scroll_animate(struct AppState *state)
+{
+    struct ScrollState *scroll_state = &state->scroll_state;
+    Uint32 now = SDL_GetTicks();
+    Uint32 elapsed = now - scroll_state->last_tick;
+    scroll_state->last_tick = now;
+
+    // the position was set elsewhere (new item, scroll to bottom), stop the animation there
+    if ((int)(scroll_state->position + 0.5f) != scroll_state->scroll_position)
+    {
+        scroll_state->position = scroll_state->scroll_position;
+        scroll_state->velocity = 0;
+        scroll_state->has_target = false;
+    }
+
+    bool animating = scroll_state->direction != 0 || scroll_state->velocity != 0 || scroll_state->has_target;
+    if (!scroll_state->needs_scroll || !animating)
+    {
+        scroll_state->held = 0;
+        scroll_state->accumulator = 0;
+        return;
+    }
+
+    scroll_state->accumulator += elapsed;
+    if (scroll_state->accumulator > SCROLL_STEP_MS * SCROLL_MAX_STEPS)
+    {
+        scroll_state->accumulator = SCROLL_STEP_MS * SCROLL_MAX_STEPS;
+    }
+
+    float max_scroll = scroll_state->content_height - scroll_state->viewport_height;
+    while (scroll_state->accumulator >= SCROLL_STEP_MS)
+    {
+        scroll_step(scroll_state, max_scroll);
+        scroll_state->accumulator -= SCROLL_STEP_MS;
+    }
+
+    int position = (int)(scroll_state->position + 0.5f);
+    if (position != scroll_state->scroll_position)
+    {
+        scroll_state->scroll_position = position;
+        scroll_state->scroll_to_bottom = false;
+        state->redraw = 1;
+    }
+}
+
+// handle_input interprets input events and mutates app state
+void handle_input(struct AppState *state)
+{
+    if (state->timeout_seconds < 0)
+    {
+        return;
+    }
+
+    if (increment_item_list_index)
+    {
+        pthread_mutex_lock(&increment_item_list_index_lock);
+        increment_item_list_index = 0;
+        state->items_state->selected += 1;
+        state->items_state->direction = 1;
+        bool should_return = false;
+        if (state->items_state->selected >= state->items_state->item_count)
+        {
+            if (state->quit_after_last_item)
             {
                 state->redraw = 0;
                 state->quitting = 1;
@@ -593,6 +1418,9 @@ void handle_input(struct AppState *state)
             }
         }
         state->redraw = 1;
+        // For the new message, ensure we start at the bottom
+        state->scroll_state.scroll_position = 0;
+        state->scroll_state.scroll_to_bottom = true;
         pthread_mutex_unlock(&increment_item_list_index_lock);
         if (should_return)
         {
@@ -732,27 +1560,37 @@ void handle_input(struct AppState *state)
     //     return;
     // }
 
-    // Handle scrolling with up/down buttons
-    int scroll_speed = SCALE1(20); // Scrolling speed in pixels
-
-    if (PAD_justRepeated(BTN_UP) || PAD_justPressed(BTN_UP))
+    // Handle scrolling: up/down scroll smoothly and speed up while held, L1/R1 jump a page
+    // the movement itself is run by scroll_animate
+    struct ScrollState *scroll_state = &state->scroll_state;
+    int direction = 0;
+    if (PAD_isPressed(BTN_UP))
     {
-        if (state->scroll_state.needs_scroll)
-        {
-            state->scroll_state.scroll_position = MAX(0, state->scroll_state.scroll_position - scroll_speed);
-            state->redraw = 1;
-            state->scroll_state.scroll_to_bottom = false;
-        }
+        direction = -1;
     }
-    else if (PAD_justRepeated(BTN_DOWN) || PAD_justPressed(BTN_DOWN))
+    else if (PAD_isPressed(BTN_DOWN))
     {
-        if (state->scroll_state.needs_scroll)
-        {
-            int max_scroll = state->scroll_state.content_height - state->scroll_state.viewport_height;
-            state->scroll_state.scroll_position = MIN(max_scroll, state->scroll_state.scroll_position + scroll_speed);
-            state->redraw = 1;
-            state->scroll_state.scroll_to_bottom = false;
-        }
+        direction = 1;
+    }
+    else if (PAD_justPressed(BTN_UP) || PAD_justPressed(BTN_DOWN))
+    {
+        // a tap shorter than a poll still glides a little
+        scroll_state->velocity = PAD_justPressed(BTN_UP) ? -SCROLL_BASE_SPEED : SCROLL_BASE_SPEED;
+    }
+    if (direction != scroll_state->direction)
+    {
+        scroll_state->held = 0;
+    }
+    scroll_state->direction = direction;
+
+    if (scroll_state->needs_scroll && (PAD_justPressed(BTN_L1) || PAD_justPressed(BTN_R1)))
+    {
+        float max_scroll = scroll_state->content_height - scroll_state->viewport_height;
+        float from = scroll_state->has_target ? scroll_state->target : scroll_state->position;
+        float target = from + (PAD_justPressed(BTN_L1) ? -1 : 1) * scroll_state->viewport_height;
+        scroll_state->target = target < 0 ? 0 : (target > max_scroll ? max_scroll : target);
+        scroll_state->has_target = true;
+        scroll_state->velocity = 0;
     }
 
     if (PAD_justRepeated(BTN_LEFT))
@@ -764,6 +1602,7 @@ void handle_input(struct AppState *state)
         else
         {
             state->items_state->selected -= 1;
+            state->items_state->direction = -1;
             if (state->items_state->selected < 0)
             {
                 if (state->no_wrap)
@@ -798,6 +1637,7 @@ void handle_input(struct AppState *state)
         else
         {
             state->items_state->selected += 1;
+            state->items_state->direction = 1;
             if (state->items_state->selected >= state->items_state->item_count)
             {
                 if (state->quit_after_last_item)
@@ -816,11 +1656,17 @@ void handle_input(struct AppState *state)
                 {
                     state->items_state->selected = 0;
                     state->redraw = 1;
+                    // For the new message, ensure we start at the bottom
+                    state->scroll_state.scroll_position = 0;
+                    state->scroll_state.scroll_to_bottom = true; // Force display at the bottom
                 }
             }
             else
             {
                 state->redraw = 1;
+                // For the new message, ensure we start at the bottom
+                state->scroll_state.scroll_position = 0;
+                state->scroll_state.scroll_to_bottom = true; // Force display at the bottom
             }
         }
     }
@@ -849,420 +1695,3233 @@ SDL_Color hex_to_sdl_color(const char *hex)
     return color;
 }
 
-// scale_surface manually scales a surface to a new width and height for SDL1
-SDL_Surface *scale_surface(SDL_Surface *surface,
-                           Uint16 width, Uint16 height)
+// items_compile prepares the items for drawing once the screen format is known, so that
+// drawing parses nothing: the background color is mapped to a screen pixel and each
+// background image path, interned when the items were loaded, is checked for once
+void items_compile(struct ItemsState *items_state, SDL_Surface *screen)
 {
-    SDL_Surface *scaled = SDL_CreateRGBSurface(surface->flags,
-                                               width,
-                                               height,
-                                               surface->format->BitsPerPixel,
-                                               surface->format->Rmask,
-                                               surface->format->Gmask,
-                                               surface->format->Bmask,
-                                               surface->format->Amask);
-
-    int bpp = surface->format->BytesPerPixel;
-    int *v = (int *)malloc(bpp * sizeof(int));
-
-    for (int x = 0; x < width; x++)
+    for (size_t i = 0; i < items_state->item_count; i++)
     {
-        for (int y = 0; y < height; y++)
-        {
-            int xo1 = x * surface->w / width;
-            int xo2 = MAX((x + 1) * surface->w / width, xo1 + 1);
-            int yo1 = y * surface->h / height;
-            int yo2 = MAX((y + 1) * surface->h / height, yo1 + 1);
-            int n = (xo2 - xo1) * (yo2 - yo1);
+        struct Item *item = &items_state->items[i];
 
-            for (int i = 0; i < bpp; i++)
-                v[i] = 0;
+        // an empty path means no background image
+        if (item->background_image != NULL && item->background_image[0] == '\0')
+        {
+            item->background_image = NULL;
+        }
 
-            for (int xo = xo1; xo < xo2; xo++)
-                for (int yo = yo1; yo < yo2; yo++)
+        // items sharing an image share its interned path, which keeps the result of the check
+        item->image_exists = false;
+        if (item->background_image != NULL)
+        {
+            struct StringTableEntry *entry = string_table_find(&items_state->strings, item->background_image);
+            if (entry == NULL)
+            {
+                item->image_exists = access(item->background_image, F_OK) != -1;
+            }
+            else
+            {
+                if (!entry->checked)
                 {
-                    Uint8 *ps =
-                        (Uint8 *)surface->pixels + yo * surface->pitch + xo * bpp;
-                    for (int i = 0; i < bpp; i++)
-                        v[i] += ps[i];
+                    entry->exists = access(entry->string, F_OK) != -1;
+                    entry->checked = true;
                 }
-
-            Uint8 *pd = (Uint8 *)scaled->pixels + y * scaled->pitch + x * bpp;
-            for (int i = 0; i < bpp; i++)
-                pd[i] = v[i] / n;
+                item->image_exists = entry->exists;
+            }
         }
-    }
 
-    free(v);
+        // Do not clear the screen if preserve_framebuffer is active and a background is not explicitly defined
+        item->fills_background = !g_options.preserve_framebuffer ||
+                                 item->background_color != NULL ||
+                                 item->background_image != NULL;
 
-    return scaled;
+        SDL_Color color = hex_to_sdl_color(item->background_color != NULL ? item->background_color : "#000000");
+        item->background_pixel = SDL_MapRGBA(screen->format, color.r, color.g, color.b, 255);
+    }
 }
 
-// draw_screen interprets the app state and draws it to the screen
-void draw_screen(SDL_Surface *screen, struct AppState *state)
+// the SDL_ttf releases that can report kerning between two glyphs
+#if defined(USE_SDL2) && defined(SDL_TTF_VERSION_ATLEAST)
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 14)
+#define HAS_TTF_GLYPH_KERNING
+#endif
+#endif
+
+// the size of a new glyph atlas surface
+#define GLYPH_ATLAS_WIDTH 1024
+#define GLYPH_ATLAS_INITIAL_HEIGHT 256
+// the atlas is flushed instead of grown past this height
+#define GLYPH_ATLAS_MAX_HEIGHT 2048
+
+// GlyphMetrics holds the horizontal metrics of a glyph
+struct GlyphMetrics
 {
-    // Do not clear the screen if preserve_framebuffer is active and a background is not explicitly defined
-    bool should_clear = !g_options.preserve_framebuffer ||
-                        (state->items_state->items[state->items_state->selected].background_color != NULL) ||
-                        (state->items_state->items[state->items_state->selected].background_image != NULL);
+    // the unicode codepoint of the glyph
+    Uint32 codepoint;
+    // whether the metrics have been loaded
+    bool loaded;
+    // the horizontal extent of the glyph outline relative to the pen position
+    int minx;
+    int maxx;
+    // how far the pen moves after the glyph
+    int advance;
+};
 
-    if (should_clear)
-    {
-        // render a background color
-        char hex_color[1024] = "#000000";
-        if (state->items_state->items[state->items_state->selected].background_color != NULL)
-        {
-            strncpy(hex_color, state->items_state->items[state->items_state->selected].background_color, sizeof(hex_color));
-        }
+// the cached value of a kerning pair that has not been looked up yet
+#define KERNING_UNKNOWN -128
 
-        SDL_Color background_color = hex_to_sdl_color(hex_color);
-        uint32_t color = SDL_MapRGBA(screen->format, background_color.r, background_color.g, background_color.b, 255);
-        SDL_FillRect(screen, NULL, color);
-    }
+// FontMetrics holds the advances and kerning pairs of a font, loaded as they are needed
+struct FontMetrics
+{
+    // the font the metrics are read from
+    TTF_Font *font;
+    // extra pen movement SDL_ttf adds per glyph on top of the metrics (e.g. for bold)
+    int extra_advance;
+    // metrics for the ASCII range
+    struct GlyphMetrics ascii[128];
+    // open-addressed table of the remaining glyphs
+    struct GlyphMetrics *glyphs;
+    int glyph_capacity;
+    int glyph_count;
+    // kerning between two ASCII characters (NULL when the font is not kerned)
+    Sint8 *ascii_kerning;
+    // the next font in the list
+    struct FontMetrics *next;
+};
 
-    // check if there is an image and it is accessible
-    if (state->items_state->items[state->items_state->selected].background_image != NULL)
-    {
-        SDL_Surface *surface = IMG_Load(state->items_state->items[state->items_state->selected].background_image);
-        if (surface)
-        {
-            int imgW = surface->w, imgH = surface->h;
+// the font metrics loaded so far
+struct FontMetrics *font_metrics = NULL;
 
-            // Compute scale factor
-            float scaleX = (float)(FIXED_WIDTH - 2 * PADDING) / imgW;
-            float scaleY = (float)(FIXED_HEIGHT - 2 * PADDING) / imgH;
-            float scale = (scaleX < scaleY) ? scaleX : scaleY;
+// Glyph holds a rasterized glyph and its metrics
+struct Glyph
+{
+    // the unicode codepoint of the glyph
+    Uint32 codepoint;
+    // whether the glyph has been rasterized
+    bool loaded;
+    // where the glyph pixels live in the atlas surface (w is 0 for glyphs without pixels)
+    SDL_Rect rect;
+    // the horizontal offset of the glyph pixels from the pen position
+    int offset_x;
+    // how far the pen moves after the glyph
+    int advance;
+};
 
-            // Ensure upscaling only when the image is smaller than the screen
-            if (imgW * scale < FIXED_WIDTH - 2 * PADDING && imgH * scale < FIXED_HEIGHT - 2 * PADDING)
-            {
-                scale = (scaleX > scaleY) ? scaleX : scaleY;
-            }
+// GlyphAtlas holds every glyph rasterized for a font and color, packed in one surface
+struct GlyphAtlas
+{
+    // the font the glyphs are rasterized with
+    TTF_Font *font;
+    // the advances and kerning of the font
+    struct FontMetrics *metrics;
+    // the color the glyphs are rasterized in
+    SDL_Color color;
+    // the 32-bit ARGB surface holding the glyph pixels
+    SDL_Surface *surface;
+    // the position of the next free slot in the current shelf
+    int shelf_x;
+    int shelf_y;
+    // the height of a glyph (every glyph is rendered at the font height)
+    int height;
+    // incremented every time the atlas is flushed
+    int generation;
+    // glyphs for the ASCII range
+    struct Glyph ascii[128];
+    // open-addressed table of the remaining glyphs
+    struct Glyph *glyphs;
+    int glyph_capacity;
+    int glyph_count;
+    // the glyphs of the string glyph_atlas_render is drawing, kept between calls
+    struct Glyph *scratch;
+    int scratch_capacity;
+    // the next atlas in the list
+    struct GlyphAtlas *next;
+};
 
-            // Compute target dimensions
-            int dstW = imgW * scale;
-            int dstH = imgH * scale;
+// the glyph atlases created so far
+struct GlyphAtlas *glyph_atlases = NULL;
 
-            int dstX = (FIXED_WIDTH - dstW) / 2;
-            int dstY = (FIXED_HEIGHT - dstH) / 2;
-            if (imgW == FIXED_WIDTH && imgH == FIXED_HEIGHT)
-            {
-                dstW = FIXED_WIDTH;
-                dstH = FIXED_HEIGHT;
-                dstX = 0;
-                dstY = 0;
-            }
+// utf8_decode decodes the codepoint starting at text[*i] and advances *i past it
+// invalid sequences decode to U+FFFD and advance by a single byte
+Uint32 utf8_decode(const char *text, int len, int *i)
+{
+    const unsigned char *s = (const unsigned char *)text + *i;
+    int remaining = len - *i;
+    Uint32 codepoint;
+    int size;
 
-            // Compute destination rectangle
-            SDL_Rect dstRect = {dstX, dstY, dstW, dstH};
-#ifdef USE_SDL2
-            SDL_BlitScaled(surface, NULL, screen, &dstRect);
-#else
-            if (imgW == FIXED_WIDTH && imgH == FIXED_HEIGHT)
-            {
-                SDL_BlitSurface(surface, NULL, screen, &dstRect);
-            }
-            else
-            {
-                SDL_Surface *scaled = scale_surface(surface, dstW, dstH);
-                SDL_BlitSurface(scaled, NULL, screen, &dstRect);
-                SDL_FreeSurface(scaled);
-            }
-#endif
-            SDL_FreeSurface(surface);
-        }
+    if (s[0] < 0x80)
+    {
+        codepoint = s[0];
+        size = 1;
     }
-
-    // draw the button group on the button-right
-    // only two buttons can be displayed at a time
-    if (state->confirm_show && strcmp(state->confirm_button, "") != 0)
+    else if ((s[0] & 0xE0) == 0xC0)
     {
-        if (state->cancel_show && strcmp(state->cancel_button, "") != 0)
-        {
-            GFX_blitButtonGroup((char *[]){state->cancel_button, state->cancel_text, state->confirm_button, state->confirm_text, NULL}, 1, screen, 1);
-        }
-        else
-        {
-            GFX_blitButtonGroup((char *[]){state->confirm_button, state->confirm_text, NULL}, 1, screen, 1);
-        }
+        codepoint = s[0] & 0x1F;
+        size = 2;
     }
-    else if (state->cancel_show)
+    else if ((s[0] & 0xF0) == 0xE0)
     {
-        GFX_blitButtonGroup((char *[]){state->cancel_button, state->cancel_text, NULL}, 1, screen, 1);
+        codepoint = s[0] & 0x0F;
+        size = 3;
     }
-
-    int initial_padding = 0;
-    if (state->show_time_left && state->timeout_seconds > 0)
+    else if ((s[0] & 0xF8) == 0xF0)
+    {
+        codepoint = s[0] & 0x07;
+        size = 4;
+    }
+    else
     {
-        struct timeval current_time;
-        gettimeofday(&current_time, NULL);
+        *i += 1;
+        return 0xFFFD;
+    }
 
-        int time_left = state->timeout_seconds - (current_time.tv_sec - state->start_time.tv_sec);
-        if (time_left <= 0)
-        {
-            time_left = 0;
-        }
+    if (size > remaining)
+    {
+        *i += 1;
+        return 0xFFFD;
+    }
 
-        char time_left_str[1024];
-        if (time_left == 1)
-        {
-            snprintf(time_left_str, sizeof(time_left_str), "Time left: %d second", time_left);
-        }
-        else
+    for (int j = 1; j < size; j++)
+    {
+        if ((s[j] & 0xC0) != 0x80)
         {
-            snprintf(time_left_str, sizeof(time_left_str), "Time left: %d seconds", time_left);
+            *i += 1;
+            return 0xFFFD;
         }
+        codepoint = (codepoint << 6) | (s[j] & 0x3F);
+    }
 
-        SDL_Surface *text = TTF_RenderUTF8_Blended(state->fonts.small, time_left_str, COLOR_WHITE);
-        SDL_Rect pos = {
-            SCALE1(PADDING),
-            SCALE1(PADDING),
-            text->w,
-            text->h};
-        SDL_BlitSurface(text, NULL, screen, &pos);
+    *i += size;
+    return codepoint;
+}
 
-        initial_padding = text->h + SCALE1(PADDING);
+// utf8_encode writes the UTF-8 encoding of a codepoint and a null terminator into out
+void utf8_encode(Uint32 codepoint, char out[5])
+{
+    if (codepoint < 0x80)
+    {
+        out[0] = codepoint;
+        out[1] = '\0';
+    }
+    else if (codepoint < 0x800)
+    {
+        out[0] = 0xC0 | (codepoint >> 6);
+        out[1] = 0x80 | (codepoint & 0x3F);
+        out[2] = '\0';
     }
+    else if (codepoint < 0x10000)
+    {
+        out[0] = 0xE0 | (codepoint >> 12);
+        out[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        out[2] = 0x80 | (codepoint & 0x3F);
+        out[3] = '\0';
+    }
+    else
+    {
+        out[0] = 0xF0 | (codepoint >> 18);
+        out[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+        out[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+        out[3] = 0x80 | (codepoint & 0x3F);
+        out[4] = '\0';
+    }
+}
 
-    int message_padding = SCALE1(PADDING + BUTTON_PADDING);
+// glyph_kerning returns the kerning adjustment between two glyphs
+int glyph_kerning(TTF_Font *font, Uint32 previous, Uint32 codepoint)
+{
+#ifdef HAS_TTF_GLYPH_KERNING
+    if (previous == 0 || previous > 0xFFFF || codepoint > 0xFFFF || !TTF_GetFontKerning(font))
+    {
+        return 0;
+    }
+    return TTF_GetFontKerningSizeGlyphs(font, previous, codepoint);
+#else
+    return 0;
+#endif
+}
 
-    // get the width and height of every word in the message
-    struct Message words[1024];
-    int word_count = 0;
-    char original_message[1024];
-    strncpy(original_message, state->items_state->items[state->items_state->selected].text, sizeof(original_message));
+// font_metrics_get returns the metrics of a font, creating them if needed
+struct FontMetrics *font_metrics_get(TTF_Font *font)
+{
+    for (struct FontMetrics *metrics = font_metrics; metrics != NULL; metrics = metrics->next)
+    {
+        if (metrics->font == font)
+        {
+            return metrics;
+        }
+    }
 
-    // Convert literal \n into actual line breaks
-    convert_escaped_newlines(original_message);
+    struct FontMetrics *metrics = calloc(1, sizeof(struct FontMetrics));
+    if (metrics == NULL)
+    {
+        return NULL;
+    }
 
-    // Split on actual line breaks
-    char *saveptr_lines;
-    char *line = strtok_r(original_message, "\n", &saveptr_lines);
-    int word_height = 0;
-    bool first_line = true;
-    int line_count = 0;
+    metrics->glyph_capacity = 256;
+    metrics->glyphs = calloc(metrics->glyph_capacity, sizeof(struct GlyphMetrics));
+    if (metrics->glyphs == NULL)
+    {
+        free(metrics);
+        return NULL;
+    }
 
-    while (line != NULL)
+#ifdef HAS_TTF_GLYPH_KERNING
+    if (TTF_GetFontKerning(font))
     {
-        if (line_count >= MAX_MESSAGES)
+        // a missing table only means the pairs are looked up every time
+        metrics->ascii_kerning = malloc(128 * 128);
+        if (metrics->ascii_kerning != NULL)
         {
-            log_error("Too many lines in message");
-            break;
+            memset(metrics->ascii_kerning, KERNING_UNKNOWN, 128 * 128);
         }
-        line_count++;
+    }
+#endif
 
-        // For each line, split into words
-        char *saveptr_words;
-        char *word = strtok_r(line, " ", &saveptr_words);
-        bool first_word_in_line = true;
+    metrics->font = font;
+
+    // SDL_ttf may move the pen further than the glyph advance (e.g. the bold overhang)
+    int one_space = 0;
+    int two_spaces = 0;
+    int advance = 0;
+    TTF_SizeUTF8(font, " ", &one_space, NULL);
+    TTF_SizeUTF8(font, "  ", &two_spaces, NULL);
+    TTF_GlyphMetrics(font, ' ', NULL, NULL, NULL, NULL, &advance);
+    metrics->extra_advance = MAX(0, two_spaces - one_space - advance);
+
+    metrics->next = font_metrics;
+    font_metrics = metrics;
+    return metrics;
+}
 
-        while (word != NULL && word_count < 1024)
+// font_metrics_slot returns the table slot for a codepoint, growing the table if needed
+struct GlyphMetrics *font_metrics_slot(struct FontMetrics *metrics, Uint32 codepoint)
+{
+    if (codepoint < 128)
+    {
+        return &metrics->ascii[codepoint];
+    }
+
+    if ((metrics->glyph_count + 1) * 10 > metrics->glyph_capacity * 7)
+    {
+        int capacity = metrics->glyph_capacity * 2;
+        struct GlyphMetrics *glyphs = calloc(capacity, sizeof(struct GlyphMetrics));
+        if (glyphs != NULL)
         {
-            strtrim(word);
-            if (strcmp(word, "") != 0)
+            for (int i = 0; i < metrics->glyph_capacity; i++)
             {
-                int word_width;
-                TTF_SizeUTF8(state->fonts.large, word, &word_width, &word_height);
+                if (!metrics->glyphs[i].loaded)
+                {
+                    continue;
+                }
 
-                // Force a new line if it's not the first line
-                words[word_count].is_newline = !first_line && first_word_in_line;
-                strncpy(words[word_count].message, word, sizeof(words[word_count].message));
-                words[word_count].width = word_width;
-                word_count++;
-                first_word_in_line = false;
+                int j = (metrics->glyphs[i].codepoint * 2654435761u) & (capacity - 1);
+                while (glyphs[j].loaded)
+                {
+                    j = (j + 1) & (capacity - 1);
+                }
+                glyphs[j] = metrics->glyphs[i];
             }
-            word = strtok_r(NULL, " ", &saveptr_words);
+            free(metrics->glyphs);
+            metrics->glyphs = glyphs;
+            metrics->glyph_capacity = capacity;
         }
+    }
 
-        line = strtok_r(NULL, "\n", &saveptr_lines);
-        first_line = false;
+    int i = (codepoint * 2654435761u) & (metrics->glyph_capacity - 1);
+    while (metrics->glyphs[i].loaded && metrics->glyphs[i].codepoint != codepoint)
+    {
+        i = (i + 1) & (metrics->glyph_capacity - 1);
     }
+    return &metrics->glyphs[i];
+}
 
-    int letter_width = 0;
-    TTF_SizeUTF8(state->fonts.large, "A", &letter_width, NULL);
+// font_metrics_glyph returns the metrics of a glyph, reading them from the font on first use
+struct GlyphMetrics *font_metrics_glyph(struct FontMetrics *metrics, Uint32 codepoint)
+{
+    struct GlyphMetrics *glyph = font_metrics_slot(metrics, codepoint);
+    if (glyph->loaded)
+    {
+        return glyph;
+    }
 
-    // construct a list of messages that can be displayed on a single line
-    struct Message messages[MAX_MESSAGES];
-    for (int i = 0; i < MAX_MESSAGES; i++)
+    int minx = 0;
+    int maxx = 0;
+    int advance = 0;
+    if (codepoint > 0xFFFF || TTF_GlyphMetrics(metrics->font, codepoint, &minx, &maxx, NULL, NULL, &advance) != 0)
     {
-        strncpy(messages[i].message, "", sizeof(messages[i].message));
-        messages[i].width = 0;
+        // no metrics for this glyph, fall back to the size of the rendered string
+        char utf8[5];
+        utf8_encode(codepoint, utf8);
+        TTF_SizeUTF8(metrics->font, utf8, &advance, NULL);
+        advance -= metrics->extra_advance;
+        minx = 0;
+        maxx = advance;
     }
 
-    int message_count = 0;
-    int current_message_index = 0;
-    for (int i = 0; i < word_count; i++)
+    glyph->codepoint = codepoint;
+    glyph->loaded = true;
+    glyph->minx = minx;
+    glyph->maxx = maxx;
+    glyph->advance = advance + metrics->extra_advance;
+    if (codepoint >= 128)
     {
-        if (current_message_index >= MAX_MESSAGES - 1)
-        { // Keeping a safety margin
-            log_error("Maximum number of lines reached");
-            break;
-        }
+        metrics->glyph_count++;
+    }
 
-        // If the word is to start a new line (after an \n), we force a new message
-        if (words[i].is_newline)
-        {
-            current_message_index++;
-            message_count++;
-            strncpy(messages[current_message_index].message, words[i].message, sizeof(messages[current_message_index].message));
-            messages[current_message_index].width = words[i].width;
-            continue;
-        }
+    return glyph;
+}
+
+// font_metrics_kerning returns the kerning adjustment between two glyphs
+// pairs of ASCII characters are looked up once and cached
+int font_metrics_kerning(struct FontMetrics *metrics, Uint32 previous, Uint32 codepoint)
+{
+    if (previous >= 128 || codepoint >= 128 || metrics->ascii_kerning == NULL)
+    {
+        return glyph_kerning(metrics->font, previous, codepoint);
+    }
 
-        int potential_width = messages[current_message_index].width + words[i].width;
-        if (messages[current_message_index].width > 0)
+    Sint8 *pair = &metrics->ascii_kerning[previous * 128 + codepoint];
+    if (*pair == KERNING_UNKNOWN)
+    {
+        int kerning = glyph_kerning(metrics->font, previous, codepoint);
+        if (kerning < KERNING_UNKNOWN + 1)
         {
-            potential_width += letter_width;
+            kerning = KERNING_UNKNOWN + 1;
         }
-
-        if (messages[current_message_index].width == 0)
+        else if (kerning > 127)
         {
-            strncpy(messages[current_message_index].message, words[i].message, sizeof(messages[current_message_index].message));
-            messages[current_message_index].width = words[i].width;
+            kerning = 127;
         }
-        else if (potential_width <= FIXED_WIDTH - 2 * message_padding)
+        *pair = kerning;
+    }
+    return *pair;
+}
+
+// font_metrics_measure returns the width of a string from the cached advances
+// the width spans the glyph outlines and the pen movement, like TTF_SizeUTF8
+int font_metrics_measure(struct FontMetrics *metrics, const char *text, int len)
+{
+    int pen = 0;
+    int left = 0;
+    int right = 0;
+    Uint32 previous = 0;
+    int i = 0;
+    while (i < len)
+    {
+        Uint32 codepoint = utf8_decode(text, len, &i);
+        struct GlyphMetrics *glyph = font_metrics_glyph(metrics, codepoint);
+        pen += font_metrics_kerning(metrics, previous, codepoint);
+        if (pen + glyph->minx < left)
         {
-            char messageBuf[256];
-            snprintf(messageBuf, sizeof(messageBuf), "%s %s", messages[current_message_index].message, words[i].message);
-            strncpy(messages[current_message_index].message, messageBuf, sizeof(messages[current_message_index].message));
-            messages[current_message_index].width += words[i].width + letter_width;
+            left = pen + glyph->minx;
         }
-        else
+        if (pen + glyph->maxx > right)
         {
-            current_message_index++;
-            message_count++;
-            strncpy(messages[current_message_index].message, words[i].message, sizeof(messages[current_message_index].message));
-            messages[current_message_index].width = words[i].width;
+            right = pen + glyph->maxx;
         }
+        pen += glyph->advance;
+        previous = codepoint;
     }
 
-    int messages_height = (current_message_index + 1) * word_height;
-    if (current_message_index > 0)
+    if (pen > right)
     {
-        messages_height += (current_message_index)*SCALE1(state->items_state->items[state->items_state->selected].line_spacing);
+        right = pen;
     }
+    return right - left;
+}
 
-    // default to the middle of the screen
-    // Calculate viewport and content height
-    state->scroll_state.viewport_height = screen->h - SCALE1(PADDING * 2) - initial_padding;
-    state->scroll_state.content_height = messages_height;
-    state->scroll_state.needs_scroll = messages_height > state->scroll_state.viewport_height;
-
-    // If this is the first time you've displayed this message and you need to scroll to the bottom
-    if (state->scroll_state.scroll_to_bottom && state->scroll_state.needs_scroll)
+// font_metrics_free_all frees the metrics of every font
+void font_metrics_free_all(void)
+{
+    while (font_metrics != NULL)
     {
-        state->scroll_state.scroll_position = messages_height - state->scroll_state.viewport_height;
-        state->scroll_state.scroll_to_bottom = false;
+        struct FontMetrics *next = font_metrics->next;
+        free(font_metrics->glyphs);
+        free(font_metrics->ascii_kerning);
+        free(font_metrics);
+        font_metrics = next;
     }
+}
 
-    // Calculate initial Y position as a function of alignment
-    int base_y = SCALE1(PADDING) + initial_padding;
-    if (!state->scroll_state.needs_scroll)
+// glyph_atlas_flush forgets every rasterized glyph so the atlas can be refilled
+void glyph_atlas_flush(struct GlyphAtlas *atlas)
+{
+    memset(atlas->ascii, 0, sizeof(atlas->ascii));
+    memset(atlas->glyphs, 0, sizeof(struct Glyph) * atlas->glyph_capacity);
+    atlas->glyph_count = 0;
+    atlas->shelf_x = 0;
+    atlas->shelf_y = 0;
+    atlas->generation++;
+}
+
+// glyph_atlas_get returns the atlas for a font and color, creating it if needed
+struct GlyphAtlas *glyph_atlas_get(TTF_Font *font, SDL_Color color)
+{
+    for (struct GlyphAtlas *atlas = glyph_atlases; atlas != NULL; atlas = atlas->next)
     {
-        if (state->items_state->items[state->items_state->selected].alignment == MessageAlignmentMiddle)
+        if (atlas->font == font && atlas->color.r == color.r && atlas->color.g == color.g && atlas->color.b == color.b)
         {
-            base_y = (screen->h - messages_height) / 2;
-        }
-        else if (state->items_state->items[state->items_state->selected].alignment == MessageAlignmentBottom)
-        {
-            base_y = screen->h - messages_height - SCALE1(PADDING) - initial_padding;
+            return atlas;
         }
     }
 
-    // Apply scroll
+    struct FontMetrics *metrics = font_metrics_get(font);
+    if (metrics == NULL)
+    {
+        return NULL;
+    }
+
+    struct GlyphAtlas *atlas = calloc(1, sizeof(struct GlyphAtlas));
+    if (atlas == NULL)
+    {
+        return NULL;
+    }
+
+    atlas->surface = SDL_CreateRGBSurface(0, GLYPH_ATLAS_WIDTH, GLYPH_ATLAS_INITIAL_HEIGHT, 32, RGBA_MASK_8888);
+    atlas->glyph_capacity = 256;
+    atlas->glyphs = calloc(atlas->glyph_capacity, sizeof(struct Glyph));
+    if (atlas->surface == NULL || atlas->glyphs == NULL)
+    {
+        if (atlas->surface != NULL)
+        {
+            SDL_FreeSurface(atlas->surface);
+        }
+        free(atlas->glyphs);
+        free(atlas);
+        return NULL;
+    }
+    SDLX_SetAlpha(atlas->surface, SDL_SRCALPHA, 255);
+
+    atlas->font = font;
+    atlas->metrics = metrics;
+    atlas->color = color;
+    atlas->height = TTF_FontHeight(font);
+
+    atlas->next = glyph_atlases;
+    glyph_atlases = atlas;
+    return atlas;
+}
+
+// glyph_atlas_slot returns the table slot for a codepoint, growing the table if needed
+struct Glyph *glyph_atlas_slot(struct GlyphAtlas *atlas, Uint32 codepoint)
+{
+    if (codepoint < 128)
+    {
+        return &atlas->ascii[codepoint];
+    }
+
+    if ((atlas->glyph_count + 1) * 10 > atlas->glyph_capacity * 7)
+    {
+        int capacity = atlas->glyph_capacity * 2;
+        struct Glyph *glyphs = calloc(capacity, sizeof(struct Glyph));
+        if (glyphs != NULL)
+        {
+            for (int i = 0; i < atlas->glyph_capacity; i++)
+            {
+                if (!atlas->glyphs[i].loaded)
+                {
+                    continue;
+                }
+
+                int j = (atlas->glyphs[i].codepoint * 2654435761u) & (capacity - 1);
+                while (glyphs[j].loaded)
+                {
+                    j = (j + 1) & (capacity - 1);
+                }
+                glyphs[j] = atlas->glyphs[i];
+            }
+            free(atlas->glyphs);
+            atlas->glyphs = glyphs;
+            atlas->glyph_capacity = capacity;
+        }
+    }
+
+    int i = (codepoint * 2654435761u) & (atlas->glyph_capacity - 1);
+    while (atlas->glyphs[i].loaded && atlas->glyphs[i].codepoint != codepoint)
+    {
+        i = (i + 1) & (atlas->glyph_capacity - 1);
+    }
+    return &atlas->glyphs[i];
+}
+
+// glyph_atlas_reserve finds room for a w x height glyph in the atlas
+// the atlas surface is grown when it is full, and flushed once it reaches its maximum size
+bool glyph_atlas_reserve(struct GlyphAtlas *atlas, int w, SDL_Rect *rect)
+{
+    if (w > atlas->surface->w || atlas->height > GLYPH_ATLAS_MAX_HEIGHT)
+    {
+        return false;
+    }
+
+    if (atlas->shelf_x + w > atlas->surface->w)
+    {
+        atlas->shelf_x = 0;
+        atlas->shelf_y += atlas->height;
+    }
+
+    if (atlas->shelf_y + atlas->height > atlas->surface->h)
+    {
+        if (atlas->surface->h * 2 <= GLYPH_ATLAS_MAX_HEIGHT)
+        {
+            SDL_Surface *grown = SDL_CreateRGBSurface(0, atlas->surface->w, atlas->surface->h * 2, 32, RGBA_MASK_8888);
+            if (grown == NULL)
+            {
+                return false;
+            }
+
+            SDLX_SetAlpha(atlas->surface, 0, 0);
+            SDL_BlitSurface(atlas->surface, NULL, grown, NULL);
+            SDL_FreeSurface(atlas->surface);
+            SDLX_SetAlpha(grown, SDL_SRCALPHA, 255);
+            atlas->surface = grown;
+        }
+        else
+        {
+            glyph_atlas_flush(atlas);
+        }
+    }
+
+    rect->x = atlas->shelf_x;
+    rect->y = atlas->shelf_y;
+    rect->w = w;
+    rect->h = atlas->height;
+    atlas->shelf_x += w;
+    return true;
+}
+
+// glyph_atlas_glyph returns a glyph from the atlas, rasterizing it on first use
+struct Glyph *glyph_atlas_glyph(struct GlyphAtlas *atlas, Uint32 codepoint)
+{
+    struct Glyph *glyph = glyph_atlas_slot(atlas, codepoint);
+    if (glyph->loaded)
+    {
+        return glyph;
+    }
+
+    struct GlyphMetrics *metrics = font_metrics_glyph(atlas->metrics, codepoint);
+
+    char utf8[5];
+    utf8_encode(codepoint, utf8);
+
+    SDL_Rect rect = {0, 0, 0, 0};
+    SDL_Surface *rendered = TTF_RenderUTF8_Blended(atlas->font, utf8, atlas->color);
+    if (rendered != NULL)
+    {
+        int generation = atlas->generation;
+        if (glyph_atlas_reserve(atlas, rendered->w, &rect))
+        {
+            SDLX_SetAlpha(rendered, 0, 0);
+            SDL_Rect dst = rect;
+            SDL_BlitSurface(rendered, NULL, atlas->surface, &dst);
+        }
+        else
+        {
+            rect.w = 0;
+        }
+        SDL_FreeSurface(rendered);
+
+        // the atlas may have been flushed while reserving room, find the slot again
+        if (atlas->generation != generation)
+        {
+            glyph = glyph_atlas_slot(atlas, codepoint);
+        }
+    }
+
+    glyph->codepoint = codepoint;
+    glyph->loaded = true;
+    glyph->rect = rect;
+    glyph->offset_x = MIN(0, metrics->minx);
+    glyph->advance = metrics->advance;
+    if (codepoint >= 128)
+    {
+        atlas->glyph_count++;
+    }
+
+    return glyph;
+}
+
+// glyph_atlas_measure returns the width of a string drawn with the atlas
+int glyph_atlas_measure(struct GlyphAtlas *atlas, const char *text, int len)
+{
+    int pen = 0;
+    int width = 0;
+    Uint32 previous = 0;
+    int i = 0;
+    while (i < len)
+    {
+        Uint32 codepoint = utf8_decode(text, len, &i);
+        struct Glyph *glyph = glyph_atlas_glyph(atlas, codepoint);
+        pen += font_metrics_kerning(atlas->metrics, previous, codepoint);
+        width = MAX(width, pen + glyph->offset_x + glyph->rect.w);
+        pen += glyph->advance;
+        previous = codepoint;
+    }
+
+    return MAX(width, pen);
+}
+
+// glyph_atlas_draw draws a string from the atlas onto a surface, returns the drawn width
+int glyph_atlas_draw(struct GlyphAtlas *atlas, const char *text, int len, SDL_Surface *dst, int x, int y)
+{
+    int pen = 0;
+    int width = 0;
+    Uint32 previous = 0;
+    int i = 0;
+    while (i < len)
+    {
+        Uint32 codepoint = utf8_decode(text, len, &i);
+        struct Glyph *glyph = glyph_atlas_glyph(atlas, codepoint);
+        pen += font_metrics_kerning(atlas->metrics, previous, codepoint);
+        if (glyph->rect.w > 0)
+        {
+            SDL_Rect src = glyph->rect;
+            SDL_Rect pos = {x + pen + glyph->offset_x, y, glyph->rect.w, glyph->rect.h};
+            SDL_BlitSurface(atlas->surface, &src, dst, &pos);
+            width = MAX(width, pen + glyph->offset_x + glyph->rect.w);
+        }
+        pen += glyph->advance;
+        previous = codepoint;
+    }
+
+    return MAX(width, pen);
+}
+
+// glyph_atlas_render renders a string from the atlas into a new 32-bit ARGB surface
+// overlapping glyph pixels keep the most opaque value, which matches single-color text
+SDL_Surface *glyph_atlas_render(struct GlyphAtlas *atlas, const char *text, int len)
+{
+    int width = glyph_atlas_measure(atlas, text, len);
+    if (width <= 0)
+    {
+        return NULL;
+    }
+
+    SDL_Surface *surface = SDL_CreateRGBSurface(0, width, atlas->height, 32, RGBA_MASK_8888);
+    if (surface == NULL)
+    {
+        return NULL;
+    }
+
+    // look every glyph up before locking, nothing may be rasterized into the atlas while it is locked
+    if (len > atlas->scratch_capacity)
+    {
+        int capacity = MAX(len, atlas->scratch_capacity * 2);
+        struct Glyph *scratch = realloc(atlas->scratch, capacity * sizeof(struct Glyph));
+        if (scratch == NULL)
+        {
+            SDL_FreeSurface(surface);
+            return NULL;
+        }
+        atlas->scratch = scratch;
+        atlas->scratch_capacity = capacity;
+    }
+    struct Glyph *glyphs = atlas->scratch;
+
+    // a flush drops the glyphs looked up before it, so the lookup is retried once
+    // a string that still flushes the atlas cannot fit in it, its dropped glyphs are left blank
+    int count = 0;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        int generation = atlas->generation;
+        int dropped = 0;
+        count = 0;
+        int i = 0;
+        while (i < len)
+        {
+            int before = atlas->generation;
+            glyphs[count] = *glyph_atlas_glyph(atlas, utf8_decode(text, len, &i));
+            if (atlas->generation != before)
+            {
+                dropped = count;
+            }
+            count++;
+        }
+
+        if (atlas->generation == generation || attempt == 1)
+        {
+            for (int k = 0; k < dropped; k++)
+            {
+                glyphs[k].rect.w = 0;
+            }
+            break;
+        }
+    }
+
+    SDL_LockSurface(atlas->surface);
+    SDL_LockSurface(surface);
+
+    int pen = 0;
+    Uint32 previous = 0;
+    for (int k = 0; k < count; k++)
+    {
+        struct Glyph *glyph = &glyphs[k];
+        pen += font_metrics_kerning(atlas->metrics, previous, glyph->codepoint);
+
+        int x0 = pen + glyph->offset_x;
+        for (int y = 0; y < glyph->rect.h && y < surface->h; y++)
+        {
+            Uint32 *src = (Uint32 *)((Uint8 *)atlas->surface->pixels + (glyph->rect.y + y) * atlas->surface->pitch) + glyph->rect.x;
+            Uint32 *row = (Uint32 *)((Uint8 *)surface->pixels + y * surface->pitch);
+            for (int x = 0; x < glyph->rect.w; x++)
+            {
+                if (x0 + x < 0 || x0 + x >= surface->w)
+                {
+                    continue;
+                }
+
+                if ((src[x] >> 24) > (row[x0 + x] >> 24))
+                {
+                    row[x0 + x] = src[x];
+                }
+            }
+        }
+
+        pen += glyph->advance;
+        previous = glyph->codepoint;
+    }
+
+    SDL_UnlockSurface(surface);
+    SDL_UnlockSurface(atlas->surface);
+
+    SDLX_SetAlpha(surface, SDL_SRCALPHA, 255);
+    return surface;
+}
+
+// glyph_atlas_free_all frees every glyph atlas
+void glyph_atlas_free_all(void)
+{
+    while (glyph_atlases != NULL)
+    {
+        struct GlyphAtlas *next = glyph_atlases->next;
+        SDL_FreeSurface(glyph_atlases->surface);
+        free(glyph_atlases->glyphs);
+        free(glyph_atlases->scratch);
+        free(glyph_atlases);
+        glyph_atlases = next;
+    }
+}
+
+// image_fit_rect computes where an image of the given size is drawn on the screen
+SDL_Rect image_fit_rect(int imgW, int imgH)
+{
+    // Compute scale factor
+    float scaleX = (float)(FIXED_WIDTH - 2 * PADDING) / imgW;
+    float scaleY = (float)(FIXED_HEIGHT - 2 * PADDING) / imgH;
+    float scale = (scaleX < scaleY) ? scaleX : scaleY;
+
+    // Ensure upscaling only when the image is smaller than the screen
+    if (imgW * scale < FIXED_WIDTH - 2 * PADDING && imgH * scale < FIXED_HEIGHT - 2 * PADDING)
+    {
+        scale = (scaleX > scaleY) ? scaleX : scaleY;
+    }
+
+    // Compute target dimensions
+    int dstW = imgW * scale;
+    int dstH = imgH * scale;
+
+    int dstX = (FIXED_WIDTH - dstW) / 2;
+    int dstY = (FIXED_HEIGHT - dstH) / 2;
+    if (imgW == FIXED_WIDTH && imgH == FIXED_HEIGHT)
+    {
+        dstW = FIXED_WIDTH;
+        dstH = FIXED_HEIGHT;
+        dstX = 0;
+        dstY = 0;
+    }
+
+    SDL_Rect dstRect = {dstX, dstY, dstW, dstH};
+    return dstRect;
+}
+
+// the masks of 8-bit channels stored in R, G, B (and A) byte order, as libjpeg and libpng write them
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+#define RGB_MASK_BYTES_24 0x000000FF, 0x0000FF00, 0x00FF0000
+#define RGB_MASK_BYTES_32 0x000000FF, 0x0000FF00, 0x00FF0000
+#define ALPHA_MASK_BYTES_32 0xFF000000
+#else
+#define RGB_MASK_BYTES_24 0x00FF0000, 0x0000FF00, 0x000000FF
+#define RGB_MASK_BYTES_32 0xFF000000, 0x00FF0000, 0x0000FF00
+#define ALPHA_MASK_BYTES_32 0x000000FF
+#endif
+
+#ifdef HAS_LIBJPEG
+// JpegError makes libjpeg jump back to the decode that failed instead of exiting
+struct JpegError
+{
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+// jpeg_error_exit returns to the decode that failed
+void jpeg_error_exit(j_common_ptr info)
+{
+    struct JpegError *error = (struct JpegError *)info->err;
+    longjmp(error->jump, 1);
+}
+
+// jpeg_silence drops the warnings of libjpeg, the image falls back to IMG_Load if it cannot be decoded
+void jpeg_silence(j_common_ptr info)
+{
+}
+
+// jpeg_load_reduced decodes a JPEG at the smallest DCT scale (1/2, 1/4 or 1/8) still covering where it is drawn
+// returns NULL if the image is not large enough to be reduced or cannot be decoded this way
+SDL_Surface *jpeg_load_reduced(FILE *file, SDL_Rect *dst)
+{
+    struct jpeg_decompress_struct info;
+    struct JpegError error;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpeg_error_exit;
+    error.manager.output_message = jpeg_silence;
+
+    SDL_Surface *volatile surface = NULL;
+    if (setjmp(error.jump))
+    {
+        jpeg_destroy_decompress(&info);
+        if (surface != NULL)
+        {
+            SDL_FreeSurface(surface);
+        }
+        return NULL;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_stdio_src(&info, file);
+    jpeg_read_header(&info, TRUE);
+
+    SDL_Rect fit = image_fit_rect(info.image_width, info.image_height);
+    int denominator = 8;
+    while (denominator > 1 && ((int)(info.image_width + denominator - 1) / denominator < fit.w || (int)(info.image_height + denominator - 1) / denominator < fit.h))
+    {
+        denominator /= 2;
+    }
+    if (denominator == 1)
+    {
+        jpeg_destroy_decompress(&info);
+        return NULL;
+    }
+
+    info.scale_num = 1;
+    info.scale_denom = denominator;
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+
+    surface = SDL_CreateRGBSurface(0, info.output_width, info.output_height, 24, RGB_MASK_BYTES_24, 0);
+    if (surface == NULL || info.output_components != 3)
+    {
+        longjmp(error.jump, 1);
+    }
+
+    while (info.output_scanline < info.output_height)
+    {
+        JSAMPROW row = (Uint8 *)surface->pixels + info.output_scanline * surface->pitch;
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    *dst = fit;
+    return surface;
+}
+#endif
+
+#ifdef HAS_LIBPNG
+// png_error_exit returns to the decode that failed without printing anything
+void png_error_exit(png_structp png, png_const_charp message)
+{
+    png_longjmp(png, 1);
+}
+
+// png_silence drops the warnings of libpng
+void png_silence(png_structp png, png_const_charp message)
+{
+}
+
+// png_load_reduced decodes a PNG row by row, averaging blocks of pixels as the rows arrive,
+// so only the reduced image and one source row are ever in memory
+// returns NULL if the image is not large enough to be reduced or cannot be decoded this way (e.g. interlaced)
+SDL_Surface *png_load_reduced(FILE *file, SDL_Rect *dst)
+{
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, png_error_exit, png_silence);
+    if (png == NULL)
+    {
+        return NULL;
+    }
+    png_infop info = png_create_info_struct(png);
+    if (info == NULL)
+    {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return NULL;
+    }
+
+    SDL_Surface *volatile surface = NULL;
+    Uint8 *volatile row = NULL;
+    Uint32 *volatile sums = NULL;
+    if (setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_read_struct(&png, &info, NULL);
+        free(row);
+        free(sums);
+        if (surface != NULL)
+        {
+            SDL_FreeSurface(surface);
+        }
+        return NULL;
+    }
+
+    png_init_io(png, file);
+    png_read_info(png, info);
+
+    int width = png_get_image_width(png, info);
+    int height = png_get_image_height(png, info);
+    SDL_Rect fit = image_fit_rect(width, height);
+    int factor_x = fit.w > 0 ? width / fit.w : 0;
+    int factor_y = fit.h > 0 ? height / fit.h : 0;
+    int factor = factor_x < factor_y ? factor_x : factor_y;
+    if (factor < 2 || png_get_interlace_type(png, info) != PNG_INTERLACE_NONE)
+    {
+        png_destroy_read_struct(&png, &info, NULL);
+        return NULL;
+    }
+
+    // every format is read as 8-bit RGBA, with an opaque filler when there is no transparency
+    int color_type = png_get_color_type(png, info);
+    bool alpha = (color_type & PNG_COLOR_MASK_ALPHA) != 0 || png_get_valid(png, info, PNG_INFO_tRNS);
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    if (!alpha)
+    {
+        png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    }
+    png_read_update_info(png, info);
+    if (png_get_rowbytes(png, info) != (png_size_t)width * 4)
+    {
+        png_error(png, "unexpected row format");
+    }
+
+    int reduced_w = (width + factor - 1) / factor;
+    int reduced_h = (height + factor - 1) / factor;
+    surface = SDL_CreateRGBSurface(0, reduced_w, reduced_h, 32, RGB_MASK_BYTES_32, alpha ? ALPHA_MASK_BYTES_32 : 0);
+    row = malloc((size_t)width * 4);
+    sums = malloc(sizeof(Uint32) * reduced_w * 4);
+    if (surface == NULL || row == NULL || sums == NULL)
+    {
+        png_error(png, "out of memory");
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        if (y % factor == 0)
+        {
+            memset(sums, 0, sizeof(Uint32) * reduced_w * 4);
+        }
+
+        png_read_row(png, row, NULL);
+        for (int x = 0; x < reduced_w; x++)
+        {
+            int end = (x + 1) * factor < width ? (x + 1) * factor : width;
+            for (int column = x * factor; column < end; column++)
+            {
+                sums[x * 4] += row[column * 4];
+                sums[x * 4 + 1] += row[column * 4 + 1];
+                sums[x * 4 + 2] += row[column * 4 + 2];
+                sums[x * 4 + 3] += row[column * 4 + 3];
+            }
+        }
+
+        // the last row of a block (or of the image) completes a row of the reduced image
+        if (y % factor == factor - 1 || y == height - 1)
+        {
+            int rows = y % factor + 1;
+            Uint8 *out = (Uint8 *)surface->pixels + (y / factor) * surface->pitch;
+            for (int x = 0; x < reduced_w; x++)
+            {
+                int columns = (x + 1) * factor < width ? factor : width - x * factor;
+                Uint32 count = rows * columns;
+                for (int c = 0; c < 4; c++)
+                {
+                    out[x * 4 + c] = (sums[x * 4 + c] + count / 2) / count;
+                }
+            }
+        }
+    }
+
+    png_read_end(png, NULL);
+    png_destroy_read_struct(&png, &info, NULL);
+    free(row);
+    free(sums);
+    *dst = fit;
+    return surface;
+}
+#endif
+
+// image_load reads an image, decoding it straight to a reduced size when it is much larger than where it is drawn
+// fills in where the image is drawn, which depends on its full size
+SDL_Surface *image_load(const char *path, SDL_Rect *dst)
+{
+#if defined(HAS_LIBJPEG) || defined(HAS_LIBPNG)
+    FILE *file = fopen(path, "rb");
+    if (file != NULL)
+    {
+        Uint8 signature[8];
+        size_t length = fread(signature, 1, sizeof(signature), file);
+        rewind(file);
+
+        SDL_Surface *reduced = NULL;
+#ifdef HAS_LIBJPEG
+        if (length >= 3 && signature[0] == 0xFF && signature[1] == 0xD8 && signature[2] == 0xFF)
+        {
+            reduced = jpeg_load_reduced(file, dst);
+        }
+#endif
+#ifdef HAS_LIBPNG
+        if (length == sizeof(signature) && png_sig_cmp(signature, 0, sizeof(signature)) == 0)
+        {
+            reduced = png_load_reduced(file, dst);
+        }
+#endif
+        fclose(file);
+
+        if (reduced != NULL)
+        {
+            return reduced;
+        }
+    }
+#endif
+
+    SDL_Surface *surface = IMG_Load(path);
+    if (surface != NULL)
+    {
+        *dst = image_fit_rect(surface->w, surface->h);
+    }
+    return surface;
+}
+
+// surface_has_transparency reports whether a decoded image needs alpha blending
+bool surface_has_transparency(SDL_Surface *surface)
+{
+    if (surface->format->Amask != 0)
+    {
+        return true;
+    }
+
+#ifdef USE_SDL2
+    Uint32 key;
+    return SDL_GetColorKey(surface, &key) == 0;
+#else
+    return (surface->flags & SDL_SRCCOLORKEY) != 0;
+#endif
+}
+
+// surface_copies_to_screen reports whether a surface can be copied onto the screen as it is:
+// it is opaque and already in the screen pixel format
+bool surface_copies_to_screen(SDL_Surface *surface, SDL_Surface *screen)
+{
+    SDL_PixelFormat *format = surface->format;
+    SDL_PixelFormat *screen_format = screen->format;
+    if (format->BitsPerPixel != screen_format->BitsPerPixel ||
+        format->Rmask != screen_format->Rmask ||
+        format->Gmask != screen_format->Gmask ||
+        format->Bmask != screen_format->Bmask ||
+        format->Amask != screen_format->Amask ||
+        (surface->flags & SDL_SRCALPHA) != 0)
+    {
+        return false;
+    }
+
+#ifdef USE_SDL2
+    Uint32 key;
+    return SDL_GetColorKey(surface, &key) != 0;
+#else
+    return (surface->flags & SDL_SRCCOLORKEY) == 0;
+#endif
+}
+
+// surface_copy copies a surface that copies to the screen (see surface_copies_to_screen) to dst,
+// inside the screen clip rectangle, with one memcpy per row or a single one when whole rows line up
+void surface_copy(SDL_Surface *surface, SDL_Rect dst, SDL_Surface *screen)
+{
+    SDL_Rect clip = screen->clip_rect;
+    int x0 = dst.x > clip.x ? dst.x : clip.x;
+    int y0 = dst.y > clip.y ? dst.y : clip.y;
+    int x1 = dst.x + surface->w < clip.x + clip.w ? dst.x + surface->w : clip.x + clip.w;
+    int y1 = dst.y + surface->h < clip.y + clip.h ? dst.y + surface->h : clip.y + clip.h;
+    if (x1 <= x0 || y1 <= y0)
+    {
+        return;
+    }
+
+    if (SDL_MUSTLOCK(screen))
+    {
+        SDL_LockSurface(screen);
+    }
+
+    int bpp = screen->format->BytesPerPixel;
+    const Uint8 *src = (const Uint8 *)surface->pixels + (y0 - dst.y) * surface->pitch + (x0 - dst.x) * bpp;
+    Uint8 *out = (Uint8 *)screen->pixels + y0 * screen->pitch + x0 * bpp;
+    size_t row_bytes = (size_t)(x1 - x0) * bpp;
+    if (row_bytes == (size_t)screen->pitch && surface->pitch == screen->pitch)
+    {
+        memcpy(out, src, row_bytes * (y1 - y0));
+    }
+    else
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            memcpy(out, src, row_bytes);
+            src += surface->pitch;
+            out += screen->pitch;
+        }
+    }
+
+    if (SDL_MUSTLOCK(screen))
+    {
+        SDL_UnlockSurface(screen);
+    }
+}
+
+// prepare_image_surface converts a decoded image to its final on-screen form:
+// scaled to the destination rectangle and in the screen pixel format
+// (or 32-bit ARGB when the image has transparency)
+SDL_Surface *prepare_image_surface(SDL_Surface *surface, SDL_Rect *dst, SDL_Surface *screen, enum ScaleQuality quality)
+{
+    bool has_alpha = surface_has_transparency(surface);
+
+    // work in 32-bit ARGB so palettes, 24-bit and colorkeyed images all scale correctly
+    SDL_Surface *argb = SDL_CreateRGBSurface(0, 1, 1, 32, RGBA_MASK_8888);
+    if (argb == NULL)
+    {
+        return NULL;
+    }
+
+    SDL_Surface *work = SDL_ConvertSurface(surface, argb->format, 0);
+    if (work == NULL)
+    {
+        SDL_FreeSurface(argb);
+        return NULL;
+    }
+
+    if (work->w != dst->w || work->h != dst->h)
+    {
+        SDL_Surface *scaled = scale_surface(work, dst->w, dst->h, quality);
+        SDL_FreeSurface(work);
+        work = scaled;
+        if (work == NULL)
+        {
+            SDL_FreeSurface(argb);
+            return NULL;
+        }
+    }
+
+    SDL_Surface *converted;
+    if (has_alpha)
+    {
+        converted = work;
+        work = NULL;
+    }
+    else
+    {
+        converted = SDL_ConvertSurface(work, screen->format, 0);
+    }
+
+    if (work != NULL)
+    {
+        SDL_FreeSurface(work);
+    }
+    SDL_FreeSurface(argb);
+
+    if (converted != NULL && has_alpha)
+    {
+        SDLX_SetAlpha(converted, SDL_SRCALPHA, 255);
+    }
+
+    return converted;
+}
+
+// decoded_image_free frees a prepared image that did not make it into the cache
+void decoded_image_free(struct DecodedImage *image)
+{
+    SDL_FreeSurface(image->surface);
+    if (image->mapping != NULL)
+    {
+        munmap(image->mapping, image->mapping_size);
+    }
+}
+
+// disk_cache_key fills the header fields a disk cache file must match to be used for an image
+void disk_cache_key(struct DiskCacheHeader *key, const char *path, const struct stat *st, enum ScaleQuality quality, SDL_Surface *screen)
+{
+    // zeroed first, the fields are compared byte for byte
+    memset(key, 0, sizeof(struct DiskCacheHeader));
+    key->magic = DISK_CACHE_MAGIC;
+    key->version = DISK_CACHE_VERSION;
+    key->mtime = st->st_mtime;
+    key->size = st->st_size;
+    key->path_length = strlen(path);
+    key->target_w = FIXED_WIDTH - 2 * PADDING;
+    key->target_h = FIXED_HEIGHT - 2 * PADDING;
+    key->quality = quality;
+    key->screen_bpp = screen->format->BitsPerPixel;
+    key->screen_masks[0] = screen->format->Rmask;
+    key->screen_masks[1] = screen->format->Gmask;
+    key->screen_masks[2] = screen->format->Bmask;
+    key->screen_masks[3] = screen->format->Amask;
+}
+
+// disk_cache_file builds the path of the disk cache file for an image
+// the name hashes the path and how the image is prepared but not the source mtime and size,
+// so a changed source overwrites its old file
+void disk_cache_file(const char *dir, const char *path, const struct DiskCacheHeader *key, char *file, size_t size)
+{
+    // 64-bit FNV-1a over the path, then over the way the image is prepared
+    Uint64 hash = 14695981039346656037ULL;
+    for (const char *c = path; *c != '\0'; c++)
+    {
+        hash = (hash ^ (Uint8)*c) * 1099511628211ULL;
+    }
+
+    const Uint8 *bytes = (const Uint8 *)&key->target_w;
+    size_t length = offsetof(struct DiskCacheHeader, bpp) - offsetof(struct DiskCacheHeader, target_w);
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    snprintf(file, size, "%s/%016llx.img", dir, (unsigned long long)hash);
+}
+
+// disk_cache_load maps a prepared image from its disk cache file, without decoding anything
+// returns false if there is no file for the key or it was prepared from another version of the source
+bool disk_cache_load(const char *file, const char *path, const struct DiskCacheHeader *key, struct DecodedImage *image)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct DiskCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    // mapped private, so nothing written to the pixels ever reaches the file
+    size_t size = st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const struct DiskCacheHeader *header = mapping;
+    bool valid = memcmp(header, key, offsetof(struct DiskCacheHeader, bpp)) == 0 &&
+                 header->width > 0 && header->height > 0 &&
+                 header->pitch >= header->width * ((header->bpp + 7) / 8) &&
+                 header->pixels_offset >= sizeof(struct DiskCacheHeader) + header->path_length &&
+                 header->pixels_offset + (size_t)header->pitch * header->height <= size &&
+                 memcmp((const Uint8 *)mapping + sizeof(struct DiskCacheHeader), path, header->path_length) == 0;
+
+    SDL_Surface *surface = NULL;
+    if (valid)
+    {
+        surface = SDL_CreateRGBSurfaceFrom((Uint8 *)mapping + header->pixels_offset, header->width, header->height, header->bpp, header->pitch,
+                                           header->masks[0], header->masks[1], header->masks[2], header->masks[3]);
+    }
+    if (surface == NULL)
+    {
+        munmap(mapping, size);
+        return false;
+    }
+
+    if (header->alpha)
+    {
+        SDLX_SetAlpha(surface, SDL_SRCALPHA, 255);
+    }
+
+    image->surface = surface;
+    image->dst.x = header->dst_x;
+    image->dst.y = header->dst_y;
+    image->dst.w = header->width;
+    image->dst.h = header->height;
+    image->mapping = mapping;
+    image->mapping_size = size;
+    return true;
+}
+
+// disk_cache_store writes a prepared image to its disk cache file
+// the file is written under a temporary name then renamed, so it is never mapped half written
+void disk_cache_store(const char *file, const char *path, const struct DiskCacheHeader *key, bool alpha, const struct DecodedImage *image)
+{
+    SDL_Surface *surface = image->surface;
+    struct DiskCacheHeader header = *key;
+    header.bpp = surface->format->BitsPerPixel;
+    header.masks[0] = surface->format->Rmask;
+    header.masks[1] = surface->format->Gmask;
+    header.masks[2] = surface->format->Bmask;
+    header.masks[3] = surface->format->Amask;
+    header.alpha = alpha;
+    header.dst_x = image->dst.x;
+    header.dst_y = image->dst.y;
+    header.width = surface->w;
+    header.height = surface->h;
+    header.pitch = surface->pitch;
+    header.pixels_offset = (sizeof(header) + header.path_length + DISK_CACHE_PIXELS_ALIGN - 1) / DISK_CACHE_PIXELS_ALIGN * DISK_CACHE_PIXELS_ALIGN;
+
+    char temp[1024];
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", file);
+    int fd = mkstemp(temp);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    FILE *out = fdopen(fd, "wb");
+    if (out == NULL)
+    {
+        close(fd);
+        unlink(temp);
+        return;
+    }
+
+    static const Uint8 padding[DISK_CACHE_PIXELS_ALIGN] = {0};
+    size_t padding_size = header.pixels_offset - sizeof(header) - header.path_length;
+    size_t pixels_size = (size_t)surface->pitch * surface->h;
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                   fwrite(path, 1, header.path_length, out) == header.path_length &&
+                   fwrite(padding, 1, padding_size, out) == padding_size &&
+                   fwrite(surface->pixels, 1, pixels_size, out) == pixels_size;
+    if (fclose(out) != 0)
+    {
+        written = false;
+    }
+
+    if (!written || rename(temp, file) != 0)
+    {
+        unlink(temp);
+    }
+}
+
+// disk_cache_open creates the disk cache directory if needed
+// returns false if it cannot be used
+bool disk_cache_open(const char *dir)
+{
+    struct stat st;
+    if (mkdir(dir, 0755) != 0 && (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)))
+    {
+        return false;
+    }
+    return access(dir, W_OK) == 0;
+}
+
+// image_cache_unlink removes an entry from the LRU list without freeing it
+void image_cache_unlink(struct ImageCache *cache, struct ImageCacheEntry *entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        cache->head = entry->next;
+    }
+
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        cache->tail = entry->prev;
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+// image_cache_push_front marks an entry as the most recently used
+void image_cache_push_front(struct ImageCache *cache, struct ImageCacheEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head != NULL)
+    {
+        cache->head->prev = entry;
+    }
+    cache->head = entry;
+    if (cache->tail == NULL)
+    {
+        cache->tail = entry;
+    }
+}
+
+// image_cache_remove unlinks and frees an entry
+void image_cache_remove(struct ImageCache *cache, struct ImageCacheEntry *entry)
+{
+    image_cache_unlink(cache, entry);
+    cache->bytes -= entry->bytes;
+    SDL_FreeSurface(entry->surface);
+    if (entry->mapping != NULL)
+    {
+        munmap(entry->mapping, entry->mapping_size);
+    }
+    free(entry->path);
+    free(entry);
+}
+
+// image_cache_evict drops least recently used entries until the cache fits its memory cap
+// the most recently used entry and the entry being drawn are always kept, even if they are larger than the cap
+void image_cache_evict(struct ImageCache *cache)
+{
+    struct ImageCacheEntry *entry = cache->tail;
+    while (cache->bytes > cache->max_bytes && entry != NULL && entry != cache->head)
+    {
+        struct ImageCacheEntry *prev = entry->prev;
+        if (entry != cache->in_use && entry != cache->pinned)
+        {
+            image_cache_remove(cache, entry);
+        }
+        entry = prev;
+    }
+}
+
+// image_cache_find returns the cached image for a path scaled with the given filter, or NULL if it is not cached
+// an entry decoded before the file changed is dropped, unless it is being drawn
+// the caller holds the cache lock
+struct ImageCacheEntry *image_cache_find(struct ImageCache *cache, const char *path, time_t mtime, enum ScaleQuality quality)
+{
+    int target_w = FIXED_WIDTH - 2 * PADDING;
+    int target_h = FIXED_HEIGHT - 2 * PADDING;
+
+    for (struct ImageCacheEntry *entry = cache->head; entry != NULL; entry = entry->next)
+    {
+        if (entry->target_w != target_w || entry->target_h != target_h || entry->quality != quality || strcmp(entry->path, path) != 0)
+        {
+            continue;
+        }
+
+        if (entry->mtime != mtime)
+        {
+            // the file was replaced, decode it again
+            if (entry != cache->in_use && entry != cache->pinned)
+            {
+                image_cache_remove(cache, entry);
+            }
+            return NULL;
+        }
+        return entry;
+    }
+    return NULL;
+}
+
+// image_cache_promote marks an entry as the most recently used
+// the caller holds the cache lock
+void image_cache_promote(struct ImageCache *cache, struct ImageCacheEntry *entry)
+{
+    if (entry != cache->head)
+    {
+        image_cache_unlink(cache, entry);
+        image_cache_push_front(cache, entry);
+    }
+}
+
+// image_decode loads an image and prepares it for the screen, filling in where it is drawn
+// with a disk cache, prepared images are mapped from it when they are there and saved to it otherwise
+// it does not touch the cached entries and can run on any thread
+bool image_decode(struct ImageCache *cache, const char *path, const struct stat *st, enum ScaleQuality quality, SDL_Surface *screen, struct DecodedImage *image)
+{
+    memset(image, 0, sizeof(struct DecodedImage));
+
+    struct DiskCacheHeader key;
+    char file[1024];
+    bool disk_cache = cache->disk_cache_dir[0] != '\0';
+    if (disk_cache)
+    {
+        disk_cache_key(&key, path, st, quality, screen);
+        disk_cache_file(cache->disk_cache_dir, path, &key, file, sizeof(file));
+        if (disk_cache_load(file, path, &key, image))
+        {
+            return true;
+        }
+    }
+
+    SDL_Surface *surface = image_load(path, &image->dst);
+    if (surface == NULL)
+    {
+        return false;
+    }
+
+    bool alpha = surface_has_transparency(surface);
+    image->surface = prepare_image_surface(surface, &image->dst, screen, quality);
+    SDL_FreeSurface(surface);
+    if (image->surface == NULL)
+    {
+        return false;
+    }
+
+    if (disk_cache)
+    {
+        disk_cache_store(file, path, &key, alpha, image);
+    }
+    return true;
+}
+
+// image_cache_insert adds a decoded image as the most recently used entry
+// if another thread cached the same image meanwhile, the decoded image is freed and that entry is returned
+// the caller holds the cache lock
+struct ImageCacheEntry *image_cache_insert(struct ImageCache *cache, const char *path, time_t mtime, enum ScaleQuality quality, struct DecodedImage *image)
+{
+    struct ImageCacheEntry *entry = image_cache_find(cache, path, mtime, quality);
+    if (entry != NULL)
+    {
+        decoded_image_free(image);
+        return entry;
+    }
+
+    entry = malloc(sizeof(struct ImageCacheEntry));
+    if (entry == NULL)
+    {
+        decoded_image_free(image);
+        return NULL;
+    }
+
+    entry->path = strdup(path);
+    entry->mtime = mtime;
+    entry->target_w = FIXED_WIDTH - 2 * PADDING;
+    entry->target_h = FIXED_HEIGHT - 2 * PADDING;
+    entry->quality = quality;
+    entry->surface = image->surface;
+    entry->dst = image->dst;
+    entry->mapping = image->mapping;
+    entry->mapping_size = image->mapping_size;
+    entry->bytes = (size_t)image->surface->pitch * image->surface->h;
+
+    image_cache_push_front(cache, entry);
+    cache->bytes += entry->bytes;
+    cache->insertions++;
+    image_cache_evict(cache);
+
+    return entry;
+}
+
+// image_cache_insertions returns how many decoded images were added to the cache so far
+unsigned int image_cache_insertions(struct ImageCache *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    unsigned int insertions = cache->insertions;
+    pthread_mutex_unlock(&cache->lock);
+    return insertions;
+}
+
+// image_cache_get returns the decoded image for a path, decoding it if it is not cached
+// or if the file changed since it was decoded
+// when pending is not NULL the image is left to the prefetch worker instead: NULL is returned
+// and pending is set if the image exists but is not decoded yet
+// the entry stays valid until the next call, the prefetch worker never evicts it
+// returns NULL if the image cannot be loaded
+struct ImageCacheEntry *image_cache_get(struct ImageCache *cache, const char *path, enum ScaleQuality quality, SDL_Surface *screen, bool *pending)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->in_use = NULL;
+
+    // the prefetch worker may already be decoding this image, wait for it instead of decoding it twice
+    while (pending == NULL && cache->decoding != NULL && strcmp(cache->decoding, path) == 0)
+    {
+        pthread_cond_wait(&cache->decoded, &cache->lock);
+    }
+
+    struct ImageCacheEntry *entry = image_cache_find(cache, path, st.st_mtime, quality);
+    if (entry != NULL)
+    {
+        image_cache_promote(cache, entry);
+        cache->in_use = entry;
+        pthread_mutex_unlock(&cache->lock);
+        return entry;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (pending != NULL)
+    {
+        *pending = true;
+        return NULL;
+    }
+
+    struct DecodedImage image;
+    if (!image_decode(cache, path, &st, quality, screen, &image))
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    entry = image_cache_insert(cache, path, st.st_mtime, quality, &image);
+    cache->in_use = entry;
+    pthread_mutex_unlock(&cache->lock);
+
+    return entry;
+}
+
+// image_cache_current returns the entry being drawn when it holds the image of a path, NULL otherwise
+// only the main thread changes or invalidates the entry being drawn, so it reads it without the lock
+struct ImageCacheEntry *image_cache_current(struct ImageCache *cache, const char *path, enum ScaleQuality quality)
+{
+    struct ImageCacheEntry *entry = cache->in_use;
+    if (entry == NULL || entry->mtime == (time_t)-1 || entry->quality != quality || strcmp(entry->path, path) != 0)
+    {
+        return NULL;
+    }
+    return entry;
+}
+
+// image_cache_pin keeps the entry being drawn while images for another frame are looked up
+void image_cache_pin(struct ImageCache *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->pinned = cache->in_use;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// image_cache_unpin makes the entry kept by image_cache_pin the one being drawn again
+void image_cache_unpin(struct ImageCache *cache)
+{
+    pthread_mutex_lock(&cache->lock);
+    cache->in_use = cache->pinned;
+    cache->pinned = NULL;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// image_cache_invalidate drops every image decoded from a path, in memory and on disk,
+// for when the file was rewritten in place and its mtime may not have changed
+void image_cache_invalidate(struct ImageCache *cache, const char *path, SDL_Surface *screen)
+{
+    pthread_mutex_lock(&cache->lock);
+    struct ImageCacheEntry *entry = cache->head;
+    while (entry != NULL)
+    {
+        struct ImageCacheEntry *next = entry->next;
+        if (strcmp(entry->path, path) == 0)
+        {
+            // the entry being drawn is dropped by the next lookup instead
+            if (entry == cache->in_use || entry == cache->pinned)
+            {
+                entry->mtime = (time_t)-1;
+            }
+            else
+            {
+                image_cache_remove(cache, entry);
+            }
+        }
+        entry = next;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (cache->disk_cache_dir[0] == '\0')
+    {
+        return;
+    }
+
+    // the disk cache file names do not depend on the source mtime and size
+    struct stat st = {0};
+    for (int quality = ScaleQualityNearest; quality <= ScaleQualityLanczos3; quality++)
+    {
+        struct DiskCacheHeader key;
+        char file[1024];
+        disk_cache_key(&key, path, &st, quality, screen);
+        disk_cache_file(cache->disk_cache_dir, path, &key, file, sizeof(file));
+        unlink(file);
+    }
+}
+
+// image_cache_free frees every entry in the cache
+// the prefetch worker must be stopped first
+void image_cache_free(struct ImageCache *cache)
+{
+    while (cache->head != NULL)
+    {
+        image_cache_remove(cache, cache->head);
+    }
+    cache->in_use = NULL;
+    cache->pinned = NULL;
+}
+
+// prefetch_cancelled returns whether a newer request replaced the one the worker is on
+bool prefetch_cancelled(struct Prefetcher *prefetcher, unsigned int generation)
+{
+    pthread_mutex_lock(&prefetcher->lock);
+    bool cancelled = prefetcher->quitting || prefetcher->generation != generation;
+    pthread_mutex_unlock(&prefetcher->lock);
+    return cancelled;
+}
+
+// prefetch_neighbours decodes the image of the selected item, then those of the items ahead of it in the
+// navigation direction and the one behind it, stopping before the images would no longer fit in the cache together
+void prefetch_neighbours(struct Prefetcher *prefetcher, int selected, int direction, unsigned int generation)
+{
+    struct ImageCache *cache = prefetcher->cache;
+    int item_count = prefetcher->items_state->item_count;
+
+    // the image on screen stays cached, what is left of the cap is for the selected item and its neighbours
+    pthread_mutex_lock(&cache->lock);
+    size_t window_bytes = cache->in_use != NULL ? cache->in_use->bytes : 0;
+    pthread_mutex_unlock(&cache->lock);
+
+    for (int step = 0; step <= prefetcher->depth + 1; step++)
+    {
+        int offset = step == 0 ? 0 : step <= prefetcher->depth ? step * direction : -direction;
+        int index = selected + offset;
+        if (index < 0 || index >= item_count)
+        {
+            if (prefetcher->no_wrap)
+            {
+                continue;
+            }
+            index = ((index % item_count) + item_count) % item_count;
+        }
+
+        const char *path = prefetcher->items_state->items[index].background_image;
+        enum ScaleQuality quality = prefetcher->items_state->items[index].scale_quality;
+        struct stat st;
+        if ((step > 0 && index == selected) || path == NULL || stat(path, &st) != 0)
+        {
+            continue;
+        }
+
+        if (prefetch_cancelled(prefetcher, generation))
+        {
+            return;
+        }
+
+        pthread_mutex_lock(&cache->lock);
+        struct ImageCacheEntry *entry = image_cache_find(cache, path, st.st_mtime, quality);
+        if (entry != NULL)
+        {
+            window_bytes += entry != cache->in_use ? entry->bytes : 0;
+            image_cache_promote(cache, entry);
+            pthread_mutex_unlock(&cache->lock);
+            continue;
+        }
+        cache->decoding = path;
+        pthread_mutex_unlock(&cache->lock);
+
+        struct DecodedImage image;
+        bool decoded = image_decode(cache, path, &st, quality, screen, &image);
+
+        pthread_mutex_lock(&cache->lock);
+        bool fits = true;
+        if (decoded)
+        {
+            // the selected item is on screen as a placeholder, its image is always kept
+            fits = step == 0 || window_bytes + (size_t)image.surface->pitch * image.surface->h <= cache->max_bytes;
+            if (fits)
+            {
+                entry = image_cache_insert(cache, path, st.st_mtime, quality, &image);
+                window_bytes += entry != NULL ? entry->bytes : 0;
+            }
+            else
+            {
+                decoded_image_free(&image);
+            }
+        }
+        cache->decoding = NULL;
+        pthread_cond_broadcast(&cache->decoded);
+        pthread_mutex_unlock(&cache->lock);
+
+        if (!fits)
+        {
+            return;
+        }
+    }
+}
+
+// prefetch_worker waits for requests and prefetches around the selected item
+void *prefetch_worker(void *arg)
+{
+    struct Prefetcher *prefetcher = arg;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    while (!prefetcher->quitting)
+    {
+        if (prefetcher->completed == prefetcher->generation)
+        {
+            pthread_cond_wait(&prefetcher->wake, &prefetcher->lock);
+            continue;
+        }
+
+        unsigned int generation = prefetcher->generation;
+        int selected = prefetcher->selected;
+        int direction = prefetcher->direction;
+        pthread_mutex_unlock(&prefetcher->lock);
+
+        prefetch_neighbours(prefetcher, selected, direction, generation);
+
+        pthread_mutex_lock(&prefetcher->lock);
+        prefetcher->completed = generation;
+    }
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return NULL;
+}
+
+// prefetch_start starts the prefetch worker when there are neighbours to prefetch
+void prefetch_start(struct Prefetcher *prefetcher, struct AppState *state)
+{
+    if (prefetcher->depth <= 0 || state->items_state->item_count < 2)
+    {
+        return;
+    }
+
+    prefetcher->items_state = state->items_state;
+    prefetcher->cache = &state->image_cache;
+    prefetcher->no_wrap = state->no_wrap;
+    prefetcher->requested = -1;
+    pthread_mutex_init(&prefetcher->lock, NULL);
+    pthread_cond_init(&prefetcher->wake, NULL);
+
+    if (pthread_create(&prefetcher->thread, NULL, prefetch_worker, prefetcher) != 0)
+    {
+        log_error("Failed to start the prefetch worker, images are decoded when shown.");
+        pthread_cond_destroy(&prefetcher->wake);
+        pthread_mutex_destroy(&prefetcher->lock);
+        return;
+    }
+    prefetcher->running = true;
+}
+
+// prefetch_update asks the worker to prefetch around the selected item when the selection changed
+void prefetch_update(struct Prefetcher *prefetcher, struct ItemsState *items_state)
+{
+    if (!prefetcher->running || prefetcher->requested == items_state->selected)
+    {
+        return;
+    }
+    prefetcher->requested = items_state->selected;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->selected = items_state->selected;
+    prefetcher->direction = items_state->direction < 0 ? -1 : 1;
+    prefetcher->generation++;
+    pthread_cond_signal(&prefetcher->wake);
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+// prefetch_stop stops the prefetch worker, abandoning the request it is on
+void prefetch_stop(struct Prefetcher *prefetcher)
+{
+    if (!prefetcher->running)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->quitting = true;
+    pthread_cond_signal(&prefetcher->wake);
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    pthread_join(prefetcher->thread, NULL);
+    pthread_cond_destroy(&prefetcher->wake);
+    pthread_mutex_destroy(&prefetcher->lock);
+    prefetcher->running = false;
+}
+
+// image_watch_start watches the directories of all background images
+// items whose directory cannot be watched are checked every frame until their image exists
+void image_watch_start(struct ImageWatch *watch, struct ItemsState *items_state)
+{
+    for (int i = 0; i < items_state->item_count; i++)
+    {
+        items_state->items[i].watch = -1;
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < items_state->item_count; i++)
+    {
+        struct Item *item = &items_state->items[i];
+        if (item->background_image == NULL)
+        {
+            continue;
+        }
+
+        char directory[1024] = ".";
+        const char *slash = strrchr(item->background_image, '/');
+        if (slash != NULL)
+        {
+            snprintf(directory, sizeof(directory), "%.*s", slash == item->background_image ? 1 : (int)(slash - item->background_image), item->background_image);
+        }
+
+        // an image is only shown once its writer closed it, or once it was moved in whole
+        // a directory watched twice gets the same descriptor back
+        int wd = inotify_add_watch(watch->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+        {
+            continue;
+        }
+
+        struct ImageWatchDirectory *entry = NULL;
+        for (int j = 0; j < watch->count && entry == NULL; j++)
+        {
+            if (watch->directories[j].wd == wd)
+            {
+                entry = &watch->directories[j];
+            }
+        }
+        if (entry == NULL)
+        {
+            struct ImageWatchDirectory *directories = realloc(watch->directories, sizeof(struct ImageWatchDirectory) * (watch->count + 1));
+            if (directories == NULL)
+            {
+                inotify_rm_watch(watch->fd, wd);
+                continue;
+            }
+            watch->directories = directories;
+            entry = &watch->directories[watch->count++];
+            *entry = (struct ImageWatchDirectory){.wd = wd};
+        }
+
+        int *items = realloc(entry->items, sizeof(int) * (entry->count + 1));
+        if (items != NULL)
+        {
+            entry->items = items;
+        }
+        const char **names = realloc(entry->names, sizeof(const char *) * (entry->count + 1));
+        if (names != NULL)
+        {
+            entry->names = names;
+        }
+        if (items == NULL || names == NULL)
+        {
+            continue;
+        }
+        entry->items[entry->count] = i;
+        entry->names[entry->count] = slash != NULL ? slash + 1 : item->background_image;
+        entry->count++;
+        item->watch = wd;
+    }
+}
+
+// image_watch_update handles the pending directory events: an image that was written or moved in
+// is marked as existing and dropped from the caches, redrawing the screen when it shows the image
+// without a watch on its directory, the selected item is checked for its image instead
+void image_watch_update(struct ImageWatch *watch, struct AppState *state)
+{
+    struct ItemsState *items_state = state->items_state;
+    struct Item *selected = &items_state->items[items_state->selected];
+    if (selected->watch < 0 && !selected->image_exists && selected->background_image != NULL)
+    {
+        if (access(selected->background_image, F_OK) != -1)
+        {
+            selected->image_exists = true;
+            state->prefetcher.requested = -1;
+            state->redraw = 1;
+        }
+    }
+
+    if (watch->fd < 0)
+    {
+        return;
+    }
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(watch->fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *position = buffer; position < buffer + length; position += sizeof(struct inotify_event) + ((struct inotify_event *)position)->len)
+        {
+            struct inotify_event *event = (struct inotify_event *)position;
+            if (event->len == 0)
+            {
+                continue;
+            }
+
+            struct ImageWatchDirectory *directory = NULL;
+            for (int j = 0; j < watch->count && directory == NULL; j++)
+            {
+                if (watch->directories[j].wd == event->wd)
+                {
+                    directory = &watch->directories[j];
+                }
+            }
+            if (directory == NULL)
+            {
+                continue;
+            }
+
+            const char *invalidated = NULL;
+            for (int j = 0; j < directory->count; j++)
+            {
+                if (strcmp(directory->names[j], event->name) != 0)
+                {
+                    continue;
+                }
+
+                // items sharing the image share its cache entries
+                int i = directory->items[j];
+                struct Item *item = &items_state->items[i];
+                if (invalidated == NULL || strcmp(invalidated, item->background_image) != 0)
+                {
+                    image_cache_invalidate(&state->image_cache, item->background_image, screen);
+                    invalidated = item->background_image;
+                }
+                item->image_exists = true;
+
+                if (state->prerender.item == i)
+                {
+                    state->prerender.valid = false;
+                }
+                if (i == items_state->selected)
+                {
+                    state->redraw = 1;
+                }
+                // the prefetch worker decodes around the selected item again
+                state->prefetcher.requested = -1;
+            }
+        }
+    }
+}
+
+// image_watch_wait waits for the given time, returning early when a watched directory changes
+void image_watch_wait(struct ImageWatch *watch, int milliseconds)
+{
+    if (watch->fd < 0)
+    {
+        SDL_Delay(milliseconds);
+        return;
+    }
+
+    struct pollfd pfd = {.fd = watch->fd, .events = POLLIN};
+    poll(&pfd, 1, milliseconds);
+}
+
+// image_watch_stop removes the watches
+void image_watch_stop(struct ImageWatch *watch)
+{
+    for (int i = 0; i < watch->count; i++)
+    {
+        free(watch->directories[i].items);
+        free(watch->directories[i].names);
+    }
+    free(watch->directories);
+    watch->directories = NULL;
+    watch->count = 0;
+
+    if (watch->fd >= 0)
+    {
+        close(watch->fd);
+        watch->fd = -1;
+    }
+}
+
+// text_layout_release_surfaces frees the rendered line surfaces of a layout
+void text_layout_release_surfaces(struct TextLayout *layout)
+{
+    if (layout->line_surfaces == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < layout->line_count; i++)
+    {
+        if (layout->line_surfaces[i] != NULL)
+        {
+            SDL_FreeSurface(layout->line_surfaces[i]);
+            layout->line_surfaces[i] = NULL;
+        }
+    }
+    layout->surface_bytes = 0;
+}
+
+// line_distance returns how many lines away a line is from the visible lines
+int line_distance(int index, int first_visible, int last_visible)
+{
+    if (index < first_visible)
+    {
+        return first_visible - index;
+    }
+    if (index > last_visible)
+    {
+        return index - last_visible;
+    }
+    return 0;
+}
+
+// text_layout_line_surface returns the rendered surface of a line, rendering it if needed
+// when the cache is full, the cached lines furthest from the visible lines are evicted first
+// if every cached line is closer to the viewport than the requested one, the line is
+// rendered without being cached and *owned is set so the caller frees it
+SDL_Surface *text_layout_line_surface(struct TextLayout *layout, int index, int first_visible, int last_visible, bool *owned)
+{
+    *owned = false;
+    if (layout->line_surfaces[index] != NULL)
+    {
+        return layout->line_surfaces[index];
+    }
+
+    SDL_Surface *text = NULL;
+    struct GlyphAtlas *atlas = glyph_atlas_get(layout->font, COLOR_WHITE);
+    if (atlas != NULL)
+    {
+        text = glyph_atlas_render(atlas, layout->text + layout->lines[index].offset, layout->lines[index].length);
+    }
+    if (text == NULL)
+    {
+        return NULL;
+    }
+
+    size_t bytes = (size_t)text->pitch * text->h;
+    int distance = line_distance(index, first_visible, last_visible);
+    while (layout->surface_bytes + bytes > LINE_SURFACE_CACHE_BYTES)
+    {
+        int victim = -1;
+        int victim_distance = distance;
+        for (int i = 0; i < layout->line_count; i++)
+        {
+            if (layout->line_surfaces[i] == NULL)
+            {
+                continue;
+            }
+
+            int d = line_distance(i, first_visible, last_visible);
+            if (d > victim_distance)
+            {
+                victim = i;
+                victim_distance = d;
+            }
+        }
+
+        if (victim == -1)
+        {
+            *owned = true;
+            return text;
+        }
+
+        layout->surface_bytes -= (size_t)layout->line_surfaces[victim]->pitch * layout->line_surfaces[victim]->h;
+        SDL_FreeSurface(layout->line_surfaces[victim]);
+        layout->line_surfaces[victim] = NULL;
+    }
+
+    layout->line_surfaces[index] = text;
+    layout->surface_bytes += bytes;
+    return text;
+}
+
+// text_layout_free releases the rendered lines and the records of a layout
+void text_layout_free(struct TextLayout *layout)
+{
+    text_layout_release_surfaces(layout);
+    arena_free(&layout->arena);
+    layout->text = NULL;
+    layout->lines = NULL;
+    layout->line_surfaces = NULL;
+    layout->line_count = 0;
+    layout->valid = false;
+}
+
+// text_layout_ellipsize cuts a line so it fits the wrap width with an ellipsis after it
+// the ellipsis is written over the text following the line, which must no longer be shown
+bool text_layout_ellipsize(struct Message *line, char *text, struct FontMetrics *metrics, int wrap_width, struct Arena *arena)
+{
+    const char *ellipsis = "...";
+    int ellipsis_width = font_metrics_measure(metrics, ellipsis, strlen(ellipsis));
+    char *start = text + line->offset;
+
+    // the pen position after every prefix of the line, so any cut is measured in O(1)
+    int *pens = arena_alloc(arena, sizeof(int) * (line->length + 1));
+    if (pens == NULL)
+    {
+        return false;
+    }
+
+    int pen = 0;
+    Uint32 previous = 0;
+    int i = 0;
+    while (i < (int)line->length)
+    {
+        int codepoint_start = i;
+        Uint32 codepoint = utf8_decode(start, line->length, &i);
+        pen += font_metrics_kerning(metrics, previous, codepoint);
+        for (int j = codepoint_start; j < i; j++)
+        {
+            // cuts inside a UTF-8 sequence measure as the cut before it
+            pens[j] = pen;
+        }
+        pen += font_metrics_glyph(metrics, codepoint)->advance;
+        previous = codepoint;
+    }
+    pens[line->length] = pen;
+
+    // binary search the longest prefix that leaves room for the ellipsis
+    int low = 0;
+    int high = line->length;
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (pens[mid] + ellipsis_width <= wrap_width)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    size_t length = low;
+    while (length > 0 && (start[length] & 0xC0) == 0x80)
+    {
+        length--;
+    }
+    while (length > 0 && start[length - 1] == ' ')
+    {
+        length--;
+    }
+
+    memcpy(start + length, ellipsis, strlen(ellipsis) + 1);
+    line->length = length + strlen(ellipsis);
+    line->width = font_metrics_measure(metrics, start, line->length);
+    return true;
+}
+
+// layout_item_text returns the wrapped lines of an item's text
+// the layout is cached on the item and only recomputed when the font, font size,
+// wrap width or line spacing change
+struct TextLayout *layout_item_text(struct Item *item, TTF_Font *font, int font_size, int wrap_width)
+{
+    struct TextLayout *layout = &item->layout;
+    if (layout->valid && layout->font == font && layout->font_size == font_size && layout->wrap_width == wrap_width && layout->line_spacing == item->line_spacing && layout->max_lines == item->max_lines)
+    {
+        return layout;
+    }
+
+    text_layout_release_surfaces(layout);
+    arena_reset(&layout->arena);
+    layout->valid = false;
+
+    // Convert literal \n into actual line breaks
+    // the copy has room for an ellipsis after the last line
+    size_t text_length = strlen(item->text);
+    char *text = arena_alloc(&layout->arena, text_length + 4);
+    if (text == NULL)
+    {
+        log_error("Memory allocation failed in layout_item_text");
+        return NULL;
+    }
+    memcpy(text, item->text, text_length + 1);
+    convert_escaped_newlines(text);
+
+    struct FontMetrics *metrics = font_metrics_get(font);
+    if (metrics == NULL)
+    {
+        log_error("Memory allocation failed in layout_item_text");
+        return NULL;
+    }
+
+    // count the words so every line can be allocated at once
+    int max_words = 0;
+    for (char *c = text; *c != '\0'; c++)
+    {
+        if (*c != ' ' && *c != '\n' && (c == text || c[-1] == ' ' || c[-1] == '\n'))
+        {
+            max_words++;
+        }
+    }
+
+    // there is always at least one (possibly empty) line
+    int max_lines = max_words > 0 ? max_words : 1;
+    struct Message *lines = arena_alloc(&layout->arena, sizeof(struct Message) * max_lines);
+    if (lines == NULL)
+    {
+        log_error("Memory allocation failed in layout_item_text");
+        return NULL;
+    }
+
+    int space_width = font_metrics_glyph(metrics, ' ')->advance;
+
+    // measure every word and wrap it onto the current line or a new one
+    // the words are packed to the front of the text with a single separator
+    // between them, so every line is a contiguous span of the text
+    int line_count = 1;
+    lines[0].offset = 0;
+    lines[0].length = 0;
+    lines[0].width = 0;
+    int word_count = 0;
+    int word_height = 0;
+    bool first_line = true;
+    char *end = text;
+    char *saveptr_lines;
+    char *line = strtok_r(text, "\n", &saveptr_lines);
+    while (line != NULL)
+    {
+        // For each line, split into words
+        char *saveptr_words;
+        char *word = strtok_r(line, " ", &saveptr_words);
+        bool first_word_in_line = true;
+
+        while (word != NULL)
+        {
+            strtrim(word);
+            if (strcmp(word, "") != 0)
+            {
+                size_t length = strlen(word);
+                int word_width = font_metrics_measure(metrics, word, length);
+                word_height = TTF_FontHeight(font);
+
+                // Force a new line if it's not the first line
+                bool is_newline = !first_line && first_word_in_line;
+
+                // the separator lands before the word, so it never overwrites text not read yet
+                if (word_count > 0)
+                {
+                    *end++ = is_newline ? '\n' : ' ';
+                }
+                memmove(end, word, length);
+                size_t offset = end - text;
+                end += length;
+
+                // If the word is to start a new line (after an \n), we force a new message
+                struct Message *current = &lines[line_count - 1];
+                bool fits = current->width + space_width + word_width <= wrap_width;
+                if (current->length > 0 && (is_newline || !fits))
+                {
+                    current = &lines[line_count++];
+                    current->offset = offset;
+                    current->length = 0;
+                    current->width = 0;
+                }
+
+                if (current->length == 0)
+                {
+                    current->offset = offset;
+                }
+                else
+                {
+                    current->width += space_width;
+                }
+                current->width += word_width;
+                current->length = offset + length - current->offset;
+
+                word_count++;
+                first_word_in_line = false;
+            }
+            word = strtok_r(NULL, " ", &saveptr_words);
+        }
+
+        line = strtok_r(NULL, "\n", &saveptr_lines);
+        first_line = false;
+    }
+    *end = '\0';
+
+    if (item->max_lines > 0 && line_count > item->max_lines)
+    {
+        line_count = item->max_lines;
+        if (!text_layout_ellipsize(&lines[line_count - 1], text, metrics, wrap_width, &layout->arena))
+        {
+            log_error("Memory allocation failed in layout_item_text");
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < line_count; i++)
+    {
+        lines[i].y = i * (word_height + SCALE1(item->line_spacing));
+    }
+
+    layout->line_surfaces = arena_alloc(&layout->arena, sizeof(SDL_Surface *) * line_count);
+    if (layout->line_surfaces == NULL)
+    {
+        log_error("Memory allocation failed in layout_item_text");
+        return NULL;
+    }
+    memset(layout->line_surfaces, 0, sizeof(SDL_Surface *) * line_count);
+
+    layout->text = text;
+    layout->lines = lines;
+    layout->line_count = line_count;
+    layout->line_height = word_height;
+    layout->height = line_count * word_height + (line_count - 1) * SCALE1(item->line_spacing);
+    layout->font = font;
+    layout->font_size = font_size;
+    layout->wrap_width = wrap_width;
+    layout->line_spacing = item->line_spacing;
+    layout->max_lines = item->max_lines;
+    layout->valid = true;
+
+    return layout;
+}
+
+// text_layout_line_at returns the first line whose bottom is below the given offset
+// from the top of the layout (line_count if there is none)
+int text_layout_line_at(struct TextLayout *layout, int offset)
+{
+    int low = 0;
+    int high = layout->line_count;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (layout->lines[mid].y + layout->line_height > offset)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+    return low;
+}
+
+// message_x_position returns the x position of a message line of the given width
+int message_x_position(struct AppState *state, SDL_Surface *screen, int width)
+{
+    int x_pos;
+    // Calculation of horizontal position according to alignment
+    switch (state->items_state->items[state->items_state->selected].horizontal_alignment)
+    {
+    case HorizontalAlignmentLeft:
+        x_pos = SCALE1(HORIZONTAL_MARGIN);
+        break;
+    case HorizontalAlignmentRight:
+        x_pos = screen->w - width - SCALE1(HORIZONTAL_MARGIN);
+        break;
+    case HorizontalAlignmentCenter:
+    default:
+        x_pos = (screen->w - width) / 2;
+        break;
+    }
+
+    // Adjust X position to make room for scrollbar if necessary
+    if (state->scroll_state.needs_scroll)
+    {
+        x_pos = MIN(x_pos, screen->w - width - SCROLLBAR_WIDTH - SCROLLBAR_PADDING * 2);
+    }
+
+    return x_pos;
+}
+
+// rects_intersect returns whether two rectangles overlap
+bool rects_intersect(SDL_Rect *a, SDL_Rect *b)
+{
+    return a->x < b->x + b->w && b->x < a->x + a->w && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+// rect_union returns the smallest rectangle holding both rectangles
+SDL_Rect rect_union(SDL_Rect *a, SDL_Rect *b)
+{
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    SDL_Rect rect = {a->x < b->x ? a->x : b->x, a->y < b->y ? a->y : b->y, 0, 0};
+    rect.w = x1 - rect.x;
+    rect.h = y1 - rect.y;
+    return rect;
+}
+
+// damage_add marks a rectangle of the screen as changed
+// overlapping rectangles are merged, and too many rectangles widen the damage to the whole screen
+void damage_add(struct Damage *damage, SDL_Rect rect, SDL_Surface *screen)
+{
+    if (damage->full)
+    {
+        return;
+    }
+
+    // keep the rectangle on screen
+    SDL_Rect bounds = {0, 0, screen->w, screen->h};
+    if (rect.w <= 0 || rect.h <= 0 || !rects_intersect(&rect, &bounds))
+    {
+        return;
+    }
+    int x1 = rect.x + rect.w < screen->w ? rect.x + rect.w : screen->w;
+    int y1 = rect.y + rect.h < screen->h ? rect.y + rect.h : screen->h;
+    rect.x = rect.x < 0 ? 0 : rect.x;
+    rect.y = rect.y < 0 ? 0 : rect.y;
+    rect.w = x1 - rect.x;
+    rect.h = y1 - rect.y;
+
+    for (int i = 0; i < damage->count;)
+    {
+        if (rects_intersect(&rect, &damage->rects[i]))
+        {
+            // the merged rectangle may now overlap ones already checked, start over
+            rect = rect_union(&rect, &damage->rects[i]);
+            damage->rects[i] = damage->rects[--damage->count];
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (damage->count == MAX_DAMAGE_RECTS)
+    {
+        damage->full = true;
+        damage->count = 0;
+        return;
+    }
+    damage->rects[damage->count++] = rect;
+}
+
+// damage_intersects returns whether a rectangle overlaps the damage
+bool damage_intersects(struct Damage *damage, SDL_Rect *rect)
+{
+    if (damage->full)
+    {
+        return true;
+    }
+    for (int i = 0; i < damage->count; i++)
+    {
+        if (rects_intersect(rect, &damage->rects[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// damage_add_all marks the whole screen as changed
+void damage_add_all(struct Damage *damage)
+{
+    damage->full = true;
+    damage->count = 0;
+}
+
+// damage_reset marks nothing as changed
+void damage_reset(struct Damage *damage)
+{
+    damage->full = false;
+    damage->count = 0;
+}
+
+// PLAT_flipRects presents the changed rectangles of the screen
+// platforms able to update part of the display can provide it, the fallback flips everything
+FALLBACK_IMPLEMENTATION void PLAT_flipRects(SDL_Surface *screen, SDL_Rect *rects, int count)
+{
+    GFX_flip(screen);
+}
+
+// flip_screen presents the changed parts of the screen and forgets the damage
+void flip_screen(SDL_Surface *screen, struct Damage *damage)
+{
+    if (damage->full)
+    {
+        GFX_flip(screen);
+    }
+    else if (damage->count > 0)
+    {
+        PLAT_flipRects(screen, damage->rects, damage->count);
+    }
+    damage_reset(damage);
+}
+
+// get_current_time_ms returns a monotonic time in milliseconds
+// unlike the wall clock it does not jump when the system time is set
+unsigned long get_current_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+// countdown_update formats the time left label
+// returns true if the shown seconds changed since the last update
+bool countdown_update(struct AppState *state)
+{
+    struct Countdown *countdown = &state->countdown;
+    unsigned long elapsed = get_current_time_ms() - state->start_time;
+    int time_left = state->timeout_seconds - (int)(elapsed / 1000);
+    if (time_left < 0)
+    {
+        time_left = 0;
+    }
+
+    if (time_left == countdown->shown)
+    {
+        return false;
+    }
+    countdown->shown = time_left;
+
+    if (time_left == 1)
+    {
+        snprintf(countdown->label, sizeof(countdown->label), "Time left: %d second", time_left);
+    }
+    else
+    {
+        snprintf(countdown->label, sizeof(countdown->label), "Time left: %d seconds", time_left);
+    }
+
+    // the digits are drawn from the glyph atlas, only the width needs measuring
+    struct GlyphAtlas *atlas = glyph_atlas_get(state->fonts.small, COLOR_WHITE);
+    countdown->width = atlas != NULL ? font_metrics_measure(atlas->metrics, countdown->label, strlen(countdown->label)) : 0;
+    return true;
+}
+
+// countdown_rect returns the area of the time left label
+// the padding on both sides covers glyphs overhanging their advance
+SDL_Rect countdown_rect(struct AppState *state)
+{
+    SDL_Rect rect = {0, SCALE1(PADDING), state->countdown.width + 2 * SCALE1(PADDING), TTF_FontHeight(state->fonts.small)};
+    return rect;
+}
+
+// draw_right_buttons draws the confirm and cancel button group on the bottom-right
+// only two buttons can be displayed at a time
+void draw_right_buttons(SDL_Surface *screen, struct AppState *state)
+{
+    if (state->confirm_show && strcmp(state->confirm_button, "") != 0)
+    {
+        if (state->cancel_show && strcmp(state->cancel_button, "") != 0)
+        {
+            GFX_blitButtonGroup((char *[]){state->cancel_button, state->cancel_text, state->confirm_button, state->confirm_text, NULL}, 1, screen, 1);
+        }
+        else
+        {
+            GFX_blitButtonGroup((char *[]){state->confirm_button, state->confirm_text, NULL}, 1, screen, 1);
+        }
+    }
+    else if (state->cancel_show)
+    {
+        GFX_blitButtonGroup((char *[]){state->cancel_button, state->cancel_text, NULL}, 1, screen, 1);
+    }
+}
+
+// draw_left_buttons draws the action and inaction button group on the bottom-left
+void draw_left_buttons(SDL_Surface *screen, struct AppState *state)
+{
+    if (state->action_show && strcmp(state->action_button, "") != 0)
+    {
+        if (state->inaction_show && strcmp(state->inaction_button, "") != 0)
+        {
+            GFX_blitButtonGroup((char *[]){state->inaction_button, state->inaction_text, state->action_button, state->action_text, NULL}, 0, screen, 0);
+        }
+        else
+        {
+            GFX_blitButtonGroup((char *[]){state->action_button, state->action_text, NULL}, 0, screen, 0);
+        }
+    }
+    else if (state->inaction_show && strcmp(state->inaction_button, "") != 0)
+    {
+        GFX_blitButtonGroup((char *[]){state->inaction_button, state->inaction_text, NULL}, 0, screen, 0);
+    }
+}
+
+// compute_frame works out where everything is drawn for the current state
+// returns false if the text of the selected item cannot be laid out
+bool compute_frame(SDL_Surface *screen, struct AppState *state, struct Frame *frame)
+{
+    frame->item = &state->items_state->items[state->items_state->selected];
+
+    frame->initial_padding = 0;
+    frame->time_left = NULL;
+    frame->image_pending = false;
+    frame->image = NULL;
+    frame->image_looked_up = false;
+    if (state->show_time_left && state->timeout_seconds > 0)
+    {
+        // the main loop keeps the label current, this only formats it the first time
+        if (state->countdown.shown < 0)
+        {
+            countdown_update(state);
+        }
+        frame->time_left = state->countdown.label;
+
+        frame->initial_padding = TTF_FontHeight(state->fonts.small) + SCALE1(PADDING);
+    }
+
+    int message_padding = SCALE1(PADDING + BUTTON_PADDING);
+
+    frame->layout = layout_item_text(frame->item, state->fonts.large, state->fonts.size, FIXED_WIDTH - 2 * message_padding);
+    if (frame->layout == NULL)
+    {
+        return false;
+    }
+
+    int messages_height = frame->layout->height;
+
+    // default to the middle of the screen
+    // Calculate viewport and content height
+    state->scroll_state.viewport_height = screen->h - SCALE1(PADDING * 2) - frame->initial_padding;
+    state->scroll_state.content_height = messages_height;
+    state->scroll_state.needs_scroll = messages_height > state->scroll_state.viewport_height;
+
+    // If this is the first time you've displayed this message and you need to scroll to the bottom
+    if (state->scroll_state.scroll_to_bottom && state->scroll_state.needs_scroll)
+    {
+        state->scroll_state.scroll_position = messages_height - state->scroll_state.viewport_height;
+        state->scroll_state.scroll_to_bottom = false;
+    }
+
+    // Calculate initial Y position as a function of alignment
+    int base_y = SCALE1(PADDING) + frame->initial_padding;
+    if (!state->scroll_state.needs_scroll)
+    {
+        if (frame->item->alignment == MessageAlignmentMiddle)
+        {
+            base_y = (screen->h - messages_height) / 2;
+        }
+        else if (frame->item->alignment == MessageAlignmentBottom)
+        {
+            base_y = screen->h - messages_height - SCALE1(PADDING) - frame->initial_padding;
+        }
+    }
+
+    // Apply scroll
     int current_message_y = base_y - state->scroll_state.scroll_position;
+    frame->lines_y = current_message_y + PADDING;
+
+    // find the lines intersecting the viewport, their rendered surfaces are never evicted
+    frame->viewport_top = SCALE1(PADDING) + frame->initial_padding;
+    int viewport_bottom = frame->viewport_top + state->scroll_state.viewport_height;
+    frame->first_visible = text_layout_line_at(frame->layout, frame->viewport_top - frame->lines_y);
+    frame->last_visible = text_layout_line_at(frame->layout, viewport_bottom - frame->lines_y + frame->layout->line_height - 1) - 1;
+
+    return true;
+}
+
+// draw_region draws the part of the screen inside clip (the whole screen when clip is NULL)
+// everything is drawn in the same order whatever the clip, so regions can be redrawn alone
+void draw_region(SDL_Surface *screen, struct AppState *state, struct Frame *frame, SDL_Rect *clip)
+{
+    SDL_Rect region = {0, 0, screen->w, screen->h};
+    if (clip != NULL)
+    {
+        region = *clip;
+    }
+    SDL_SetClipRect(screen, &region);
+
+    // render a background color, mapped to the screen format when the items were compiled
+    if (frame->item->fills_background)
+    {
+        SDL_Rect fill = region;
+        SDL_FillRect(screen, &fill, frame->item->background_pixel);
+    }
 
-    for (int i = 0; i <= message_count; i++)
+    // check if there is an image and it is accessible
+    // while the prefetch worker runs it decodes the image, the background color stands in for it meanwhile;
+    // regions drawn again keep the placeholder so the screen never shows half of the image
+    bool keep_placeholder = clip != NULL && state->image_pending == frame->item;
+    if (frame->item->background_image != NULL && !keep_placeholder)
     {
-        char *message = messages[i].message;
-        if (message == NULL)
+        // the image is looked up once per frame, the other regions reuse it
+        // a watched image is dropped from the cache when its file is rewritten, so the one on screen
+        // is drawn again without checking the file
+        if (!frame->image_looked_up)
         {
-            continue;
+            frame->image = frame->item->watch >= 0 ? image_cache_current(&state->image_cache, frame->item->background_image, frame->item->scale_quality) : NULL;
+            if (frame->image == NULL)
+            {
+                bool *pending = state->prefetcher.running ? &frame->image_pending : NULL;
+                unsigned int insertions = image_cache_insertions(&state->image_cache);
+                frame->image = image_cache_get(&state->image_cache, frame->item->background_image, frame->item->scale_quality, screen, pending);
+                if (frame->image_pending)
+                {
+                    frame->image_insertions = insertions;
+                }
+            }
+            frame->image_looked_up = true;
+        }
+
+        struct ImageCacheEntry *image = frame->image;
+        if (image)
+        {
+            // opaque images were converted to the screen format once, when they were decoded
+            SDL_Rect dstRect = image->dst;
+            if (surface_copies_to_screen(image->surface, screen))
+            {
+                surface_copy(image->surface, dstRect, screen);
+            }
+            else
+            {
+                SDL_BlitSurface(image->surface, NULL, screen, &dstRect);
+            }
+        }
+    }
+
+    // the button groups and the time left only need drawing when the region reaches their rows
+    bool draw_buttons = region.y + region.h > screen->h - SCALE1(PADDING + PILL_SIZE);
+    bool draw_time_left = frame->time_left != NULL && region.y < frame->viewport_top;
+
+    // draw the button group on the button-right
+    if (draw_buttons)
+    {
+        draw_right_buttons(screen, state);
+    }
+
+    if (draw_time_left)
+    {
+        struct GlyphAtlas *atlas = glyph_atlas_get(state->fonts.small, COLOR_WHITE);
+        if (atlas != NULL)
+        {
+            glyph_atlas_draw(atlas, frame->time_left, strlen(frame->time_left), screen, SCALE1(PADDING), SCALE1(PADDING));
+        }
+    }
+
+    // only visit the lines intersecting the region (with room for their pill)
+    struct TextLayout *layout = frame->layout;
+    int band_top = region.y - SCALE1(PILL_SIZE);
+    int band_bottom = region.y + region.h + SCALE1(PADDING);
+    for (int i = text_layout_line_at(layout, band_top - frame->lines_y); i < layout->line_count; i++)
+    {
+        if (frame->lines_y + layout->lines[i].y >= band_bottom)
+        {
+            break;
         }
 
-        int width = messages[i].width;
-        SDL_Surface *text = TTF_RenderUTF8_Blended(state->fonts.large, message, COLOR_WHITE);
+        bool owned;
+        SDL_Surface *text = text_layout_line_surface(layout, i, frame->first_visible, frame->last_visible, &owned);
         if (text == NULL)
         {
             continue;
         }
 
-        int x_pos;
-        // Calculation of horizontal position according to alignment
-        switch (state->items_state->items[state->items_state->selected].horizontal_alignment)
+        SDL_Rect pos = {
+            message_x_position(state, screen, text->w),
+            frame->lines_y + layout->lines[i].y,
+            text->w,
+            text->h};
+
+        if (frame->item->show_pill)
         {
-        case HorizontalAlignmentLeft:
-            x_pos = SCALE1(HORIZONTAL_MARGIN);
-            break;
-        case HorizontalAlignmentRight:
-            x_pos = screen->w - text->w - SCALE1(HORIZONTAL_MARGIN);
-            break;
-        case HorizontalAlignmentCenter:
-        default:
-            x_pos = (screen->w - text->w) / 2;
-            break;
+            SDL_Rect pill_rect = {
+                pos.x - SCALE1(PADDING * 2),
+                pos.y - SCALE1(PADDING),
+                text->w + SCALE1(PADDING * 4),
+                SCALE1(PILL_SIZE)};
+            GFX_blitPill(ASSET_BLACK_PILL, screen, &pill_rect);
+        }
+
+        SDL_BlitSurface(text, NULL, screen, &pos);
+        if (owned)
+        {
+            SDL_FreeSurface(text);
+        }
+    }
+
+    if (draw_buttons)
+    {
+        draw_left_buttons(screen, state);
+    }
+
+    // Draw the scrollbar if necessary
+    draw_scrollbar(screen, &state->scroll_state, frame->initial_padding);
+
+    SDL_SetClipRect(screen, NULL);
+}
+
+// remember_frame records what the screen shows after a draw, so the next scroll step can reuse it
+void remember_frame(SDL_Surface *screen, struct AppState *state, struct Frame *frame)
+{
+    state->drawn.valid = true;
+    state->drawn.item = frame->item;
+    state->drawn.layout = frame->layout;
+    state->drawn.initial_padding = frame->initial_padding;
+    state->drawn.lines_y = frame->lines_y;
+    state->drawn.pixels = screen->pixels;
+}
+
+// release_offscreen_lines keeps the rendered lines of the current layout only
+// and saves the position of its last line for the spinner
+void release_offscreen_lines(SDL_Surface *screen, struct AppState *state, struct Frame *frame)
+{
+    struct TextLayout *layout = frame->layout;
+
+    // only keep the rendered lines of the layout on screen
+    static struct TextLayout *last_layout = NULL;
+    if (last_layout != NULL && last_layout != layout)
+    {
+        text_layout_release_surfaces(last_layout);
+    }
+    last_layout = layout;
+
+    // Save the position of the last message for the spinner, even when it is scrolled away
+    if (layout->line_count > 0)
+    {
+        struct Message *last = &layout->lines[layout->line_count - 1];
+        g_options.spinner.last_message_x = message_x_position(state, screen, last->width);
+        g_options.spinner.last_message_width = last->width;
+        g_options.spinner.last_message_y = frame->lines_y + last->y;
+        g_options.spinner.last_message_height = layout->line_height;
+    }
+}
+
+// draw_screen interprets the app state and draws it to the screen
+void draw_screen(SDL_Surface *screen, struct AppState *state)
+{
+    struct Frame frame;
+    if (!compute_frame(screen, state, &frame))
+    {
+        state->drawn.valid = false;
+        state->redraw = 0;
+        return;
+    }
+
+    release_offscreen_lines(screen, state, &frame);
+    draw_region(screen, state, &frame, NULL);
+    remember_frame(screen, state, &frame);
+
+    // the main loop draws the screen again once the image is decoded
+    state->image_pending = frame.image_pending ? frame.item : NULL;
+    state->image_insertions = frame.image_insertions;
+
+    // don't forget to reset the should_redraw flag
+    state->redraw = 0;
+}
+
+// scroll_screen redraws the screen after a scroll step by moving the text band
+// that is already on screen and drawing only the rows it exposed and the chrome
+// returns false (drawing nothing) when the screen must be redrawn in full
+bool scroll_screen(SDL_Surface *screen, struct AppState *state)
+{
+    if (!state->drawn.valid || state->framebuffer_moves || g_options.spinner.active || screen->pixels != state->drawn.pixels)
+    {
+        return false;
+    }
+
+    struct Frame frame;
+    if (!compute_frame(screen, state, &frame))
+    {
+        return false;
+    }
+
+    // the background must look the same wherever the text moves to
+    bool solid_background = frame.item->background_image == NULL && frame.item->fills_background;
+    if (!solid_background || frame.item != state->drawn.item || frame.layout != state->drawn.layout || frame.initial_padding != state->drawn.initial_padding)
+    {
+        return false;
+    }
+
+    // the band holds only text and background: the chrome sits above it (time left)
+    // below it (buttons) and in the scrollbar column, and is redrawn separately
+    int band_top = frame.viewport_top;
+    int band_bottom = screen->h - SCALE1(PADDING + PILL_SIZE);
+    int delta = frame.lines_y - state->drawn.lines_y;
+    if (delta == 0 || abs(delta) >= band_bottom - band_top)
+    {
+        return false;
+    }
+
+    release_offscreen_lines(screen, state, &frame);
+
+    if (SDL_MUSTLOCK(screen))
+    {
+        SDL_LockSurface(screen);
+    }
+    Uint8 *pixels = (Uint8 *)screen->pixels;
+    size_t moved = (size_t)(band_bottom - band_top - abs(delta)) * screen->pitch;
+    SDL_Rect exposed = {0, 0, screen->w, abs(delta)};
+    if (delta > 0)
+    {
+        memmove(pixels + (band_top + delta) * screen->pitch, pixels + band_top * screen->pitch, moved);
+        exposed.y = band_top;
+    }
+    else
+    {
+        memmove(pixels + band_top * screen->pitch, pixels + (band_top - delta) * screen->pitch, moved);
+        exposed.y = band_bottom + delta;
+    }
+    if (SDL_MUSTLOCK(screen))
+    {
+        SDL_UnlockSurface(screen);
+    }
+
+    SDL_Rect top = {0, 0, screen->w, band_top};
+    SDL_Rect bottom = {0, band_bottom, screen->w, screen->h - band_bottom};
+    SDL_Rect scrollbar = {screen->w - SCROLLBAR_WIDTH - SCROLLBAR_PADDING, band_top, SCROLLBAR_WIDTH, band_bottom - band_top};
+    draw_region(screen, state, &frame, &exposed);
+    draw_region(screen, state, &frame, &top);
+    draw_region(screen, state, &frame, &bottom);
+    draw_region(screen, state, &frame, &scrollbar);
+    remember_frame(screen, state, &frame);
+
+    state->redraw = 0;
+    return true;
+}
+
+// draw_damage draws again the regions widgets reported as changed
+void draw_damage(SDL_Surface *screen, struct AppState *state)
+{
+    if (state->damage.full)
+    {
+        draw_screen(screen, state);
+        damage_add_all(&state->flip_damage);
+        damage_reset(&state->damage);
+        return;
+    }
+
+    struct Frame frame;
+    if (compute_frame(screen, state, &frame))
+    {
+        for (int i = 0; i < state->damage.count; i++)
+        {
+            draw_region(screen, state, &frame, &state->damage.rects[i]);
+            damage_add(&state->flip_damage, state->damage.rects[i], screen);
+        }
+    }
+    damage_reset(&state->damage);
+}
+
+// prerender_target returns the item shown after the selected one (RIGHT or SIGUSR1), or -1 if there is none
+int prerender_target(struct AppState *state)
+{
+    int next = state->items_state->selected + 1;
+    if (next >= (int)state->items_state->item_count)
+    {
+        if (state->quit_after_last_item || state->no_wrap)
+        {
+            return -1;
         }
+        next = 0;
+    }
+    return next == state->items_state->selected ? -1 : next;
+}
+
+// prerender_matches returns whether the composed frame still shows an item as it would be drawn now
+bool prerender_matches(struct AppState *state, int item)
+{
+    struct Prerender *prerender = &state->prerender;
+    return prerender->valid &&
+           prerender->item == item &&
+           prerender->scroll_position == state->scroll_state.scroll_position &&
+           prerender->scroll_to_bottom == state->scroll_state.scroll_to_bottom &&
+           prerender->image_exists == state->items_state->items[item].image_exists;
+}
 
-        // Adjust X position to make room for scrollbar if necessary
-        if (state->scroll_state.needs_scroll)
-        {
-            x_pos = MIN(x_pos, screen->w - text->w - SCROLLBAR_WIDTH - SCROLLBAR_PADDING * 2);
-        }
+// prerender_next composes the next item offscreen, so showing it is a single copy
+// it leaves the app state as it found it, and does nothing if the frame is already composed
+void prerender_next(SDL_Surface *screen, struct AppState *state)
+{
+    struct Prerender *prerender = &state->prerender;
 
-        SDL_Rect pos = {
-            x_pos,
-            current_message_y + PADDING,
-            text->w,
-            text->h};
+    // a preserved framebuffer shows through the frame, which cannot be composed offscreen
+    int item = prerender_target(state);
+    if (item < 0 || g_options.preserve_framebuffer || prerender_matches(state, item) || (prerender->failed && prerender->item == item))
+    {
+        return;
+    }
 
-        // Save the position of the last message for the spinner
-        if (i == message_count)
-        {
-            g_options.spinner.last_message_x = x_pos;
-            g_options.spinner.last_message_width = text->w;
-            g_options.spinner.last_message_y = pos.y;
-            g_options.spinner.last_message_height = text->h;
-        }
+    // the image of the next item is still being decoded, compose it once the cache received something new
+    if (prerender->image_pending && prerender->item == item && image_cache_insertions(&state->image_cache) == prerender->image_insertions)
+    {
+        return;
+    }
 
-        if (state->items_state->items[state->items_state->selected].show_pill)
+    // the rendered lines of an item that is no longer next are not needed anymore
+    if (prerender->item >= 0 && prerender->item != item && prerender->item != state->items_state->selected)
+    {
+        text_layout_release_surfaces(&state->items_state->items[prerender->item].layout);
+    }
+    prerender->valid = false;
+    prerender->image_pending = false;
+    prerender->failed = false;
+    prerender->item = item;
+
+    if (prerender->surface == NULL)
+    {
+        prerender->surface = SDL_CreateRGBSurface(0, screen->w, screen->h, screen->format->BitsPerPixel, screen->format->Rmask, screen->format->Gmask, screen->format->Bmask, screen->format->Amask);
+        if (prerender->surface == NULL)
         {
-            SDL_Rect pill_rect = {
-                pos.x - SCALE1(PADDING * 2),
-                pos.y - SCALE1(PADDING),
-                text->w + SCALE1(PADDING * 4),
-                SCALE1(PILL_SIZE)};
-            GFX_blitPill(ASSET_BLACK_PILL, screen, &pill_rect);
+            prerender->failed = true;
+            return;
         }
+        // the frame replaces the screen, it is never blended onto it
+        SDLX_SetAlpha(prerender->surface, 0, 0);
+    }
 
-        SDL_BlitSurface(text, NULL, screen, &pos);
-        current_message_y += word_height + SCALE1(state->items_state->items[state->items_state->selected].line_spacing);
-        SDL_FreeSurface(text);
+    // draw the next item as handle_input would select it, starting at its bottom, then put the state back
+    int selected = state->items_state->selected;
+    struct ScrollState scroll_state = state->scroll_state;
+    prerender->scroll_position = 0;
+    prerender->scroll_to_bottom = true;
+    prerender->image_exists = state->items_state->items[item].image_exists;
+    prerender->countdown_shown = state->countdown.shown;
+
+    state->items_state->selected = item;
+    state->scroll_state.scroll_position = prerender->scroll_position;
+    state->scroll_state.scroll_to_bottom = prerender->scroll_to_bottom;
+
+    // the image on screen must outlive the lookups of the next item
+    image_cache_pin(&state->image_cache);
+    struct Frame frame;
+    if (compute_frame(prerender->surface, state, &frame))
+    {
+        draw_region(prerender->surface, state, &frame, NULL);
+        prerender->valid = !frame.image_pending;
+        prerender->image_pending = frame.image_pending;
+        prerender->image_insertions = frame.image_insertions;
     }
-    // Draw the scrollbar if necessary
-    draw_scrollbar(screen, &state->scroll_state, initial_padding);
+    else
+    {
+        prerender->failed = true;
+    }
+    image_cache_unpin(&state->image_cache);
 
-    if (state->action_show && strcmp(state->action_button, "") != 0)
+    state->items_state->selected = selected;
+    state->scroll_state = scroll_state;
+}
+
+// prerender_present shows the composed frame if it is the selected item
+// returns false (drawing nothing) when the screen must be drawn
+bool prerender_present(SDL_Surface *screen, struct AppState *state)
+{
+    struct Prerender *prerender = &state->prerender;
+    if (!prerender_matches(state, state->items_state->selected))
     {
-        if (state->inaction_show && strcmp(state->inaction_button, "") != 0)
-        {
-            GFX_blitButtonGroup((char *[]){state->inaction_button, state->inaction_text, state->action_button, state->action_text, NULL}, 0, screen, 0);
-        }
-        else
-        {
-            GFX_blitButtonGroup((char *[]){state->action_button, state->action_text, NULL}, 0, screen, 0);
-        }
+        return false;
     }
-    else if (state->inaction_show && strcmp(state->inaction_button, "") != 0)
+
+    struct Frame frame;
+    if (!compute_frame(screen, state, &frame))
     {
-        GFX_blitButtonGroup((char *[]){state->inaction_button, state->inaction_text, NULL}, 0, screen, 0);
+        return false;
     }
 
-    // Draw the scrollbar if necessary
+    release_offscreen_lines(screen, state, &frame);
+    SDL_Rect origin = {0, 0, screen->w, screen->h};
+    if (surface_copies_to_screen(prerender->surface, screen))
+    {
+        surface_copy(prerender->surface, origin, screen);
+    }
+    else
+    {
+        SDL_BlitSurface(prerender->surface, NULL, screen, NULL);
+    }
+    remember_frame(screen, state, &frame);
+    state->image_pending = NULL;
 
-    draw_scrollbar(screen, &state->scroll_state, initial_padding);
+    // the time left may have ticked since the frame was composed
+    if (frame.time_left != NULL && prerender->countdown_shown != state->countdown.shown)
+    {
+        SDL_Rect row = {0, SCALE1(PADDING), screen->w, TTF_FontHeight(state->fonts.small)};
+        damage_add(&state->damage, row, screen);
+        draw_damage(screen, state);
+    }
 
-    // don't forget to reset the should_redraw flag
+    // the next idle moment composes the item after this one
+    prerender->valid = false;
     state->redraw = 0;
+    return true;
+}
+
+// prerender_free releases the composed frame
+void prerender_free(struct Prerender *prerender)
+{
+    if (prerender->surface != NULL)
+    {
+        SDL_FreeSurface(prerender->surface);
+        prerender->surface = NULL;
+    }
+    prerender->valid = false;
 }
 
 void draw_scrollbar(SDL_Surface *screen, struct ScrollState *scroll_state, int initial_padding)
@@ -1376,8 +5035,13 @@ void signal_handler(int signal)
 // - --cancel-text <text> (default: "BACK")
 // - --cancel-show (default: false)
 // - --disable-auto-sleep (default: false)
+// - --disk-cache-dir <path> (default: empty string, disabled)
 // - --horizontal-alignment <left|center|right> (default: center)
+// - --image-cache-size <megabytes> (default: IMAGE_CACHE_DEFAULT_SIZE_MB, from 0 to IMAGE_CACHE_MAX_SIZE_MB)
 // - --line-spacing <pixels> (default: PADDING)
+// - --max-lines <lines> (default: 0, no limit)
+// - --prefetch-depth <items> (default: PREFETCH_DEFAULT_DEPTH, from 0 to PREFETCH_MAX_DEPTH)
+// - --scale-quality <nearest|bilinear|box|lanczos3> (default: box)
 // - --preserve-framebuffer (no clear screen between launches)
 // - --inaction-button <button> (default: empty string)
 // - --inaction-text <text> (default: "OTHER")
@@ -1393,6 +5057,8 @@ void signal_handler(int signal)
 // - --show-hardware-group (default: false)
 // - --show-pill (default: false)
 // - --show-time-left (default: false)
+// - --spinner-style <line|dots|arc|path> (default: line)
+// - --spinner-fps <frames> (default: SPINNER_DEFAULT_FPS)
 // - --timeout <seconds> (default: 1)
 bool parse_arguments(struct AppState *state, int argc, char *argv[])
 {
@@ -1411,10 +5077,17 @@ bool parse_arguments(struct AppState *state, int argc, char *argv[])
         {"font-default", required_argument, 0, 'f'},
         {"font-size-default", required_argument, 0, 'F'},
         {"horizontal-alignment", required_argument, 0, 'h'},
+        {"image-cache-size", required_argument, 0, 'O'},
+        {"disk-cache-dir", required_argument, 0, 'k'},
         {"help", no_argument, 0, 'H'},
         {"line-spacing", required_argument, 0, 'l'},
+        {"max-lines", required_argument, 0, 'L'},
+        {"prefetch-depth", required_argument, 0, 'R'},
+        {"scale-quality", required_argument, 0, 'q'},
         {"preserve-framebuffer", no_argument, 0, 'p'},
         {"show-spinner", no_argument, 0, 's'},
+        {"spinner-style", required_argument, 0, 'g'},
+        {"spinner-fps", required_argument, 0, 'G'},
         {"item-key", required_argument, 0, 'K'},
         {"message", required_argument, 0, 'm'},
         {"message-alignment", required_argument, 0, 'M'},
@@ -1434,11 +5107,13 @@ bool parse_arguments(struct AppState *state, int argc, char *argv[])
 
     int opt;
     char *font_path = NULL;
-    char message[1024];
+    const char *message = "";
     char alignment[1024] = "";
     char horizontal_alignment[1024] = "center"; // default value
     int line_spacing = PADDING;                 // default value
-    while ((opt = getopt_long(argc, argv, "a:A:b:B:c:C:d:D:E:f:F:h:H:i:I:K:l:m:M:Npst:QPSTUWYXZ", long_options, NULL)) != -1)
+    int max_lines = 0;                          // default value
+    char scale_quality[1024] = "box";           // default value
+    while ((opt = getopt_long(argc, argv, "a:A:b:B:c:C:d:D:E:f:F:g:G:h:H:i:I:k:K:l:L:m:M:NO:pq:R:st:QPSTUWYXZ", long_options, NULL)) != -1)
     {
         switch (opt)
         {
@@ -1494,8 +5169,16 @@ bool parse_arguments(struct AppState *state, int argc, char *argv[])
         case 'l':
             line_spacing = atoi(optarg);
             break;
+        case 'L':
+            max_lines = atoi(optarg);
+            if (max_lines < 0)
+            {
+                log_error("Invalid max lines provided");
+                return false;
+            }
+            break;
         case 'm':
-            strncpy(message, optarg, sizeof(message));
+            message = optarg;
             break;
         case 'M':
             strncpy(alignment, optarg, sizeof(alignment));
@@ -1506,6 +5189,21 @@ bool parse_arguments(struct AppState *state, int argc, char *argv[])
         case 'N':
             state->no_wrap = true;
             break;
+        case 'O':
+        {
+            // atoi would read garbage as 0 and silently cap the cache at nothing
+            char *end;
+            long megabytes = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || megabytes < 0 || megabytes > IMAGE_CACHE_MAX_SIZE_MB)
+            {
+                char buff[256];
+                snprintf(buff, sizeof(buff), "Invalid image cache size provided, it must be from 0 to %d", IMAGE_CACHE_MAX_SIZE_MB);
+                log_error(buff);
+                return false;
+            }
+            state->image_cache.max_bytes = (size_t)megabytes * 1024 * 1024;
+            break;
+        }
         case 'P':
             state->show_pill = true;
             break;
@@ -1536,9 +5234,36 @@ bool parse_arguments(struct AppState *state, int argc, char *argv[])
         case 'p':
             g_options.preserve_framebuffer = true;
             break;
+        case 'R':
+        {
+            // atoi would read garbage as 0 and silently disable prefetching
+            char *end;
+            long depth = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || depth < 0 || depth > PREFETCH_MAX_DEPTH)
+            {
+                char buff[256];
+                snprintf(buff, sizeof(buff), "Invalid prefetch depth provided, it must be from 0 to %d", PREFETCH_MAX_DEPTH);
+                log_error(buff);
+                return false;
+            }
+            state->prefetcher.depth = (int)depth;
+            break;
+        }
+        case 'q':
+            strncpy(scale_quality, optarg, sizeof(scale_quality) - 1);
+            break;
+        case 'k':
+            strncpy(state->image_cache.disk_cache_dir, optarg, sizeof(state->image_cache.disk_cache_dir) - 1);
+            break;
         case 's':
             g_options.spinner.active = true;
             break;
+        case 'g':
+            strncpy(g_options.spinner.style, optarg, sizeof(g_options.spinner.style) - 1);
+            break;
+        case 'G':
+            g_options.spinner.fps = atoi(optarg);
+            break;
         default:
             return false;
         }
@@ -1582,42 +5307,66 @@ bool parse_arguments(struct AppState *state, int argc, char *argv[])
         return false;
     }
 
+    enum ScaleQuality default_scale_quality;
+    if (!parse_scale_quality(scale_quality, &default_scale_quality))
+    {
+        log_error("Invalid scale quality provided");
+        return false;
+    }
+
     if (strlen(message) > 0)
     {
-        struct ItemsState *items_state = malloc(sizeof(struct ItemsState));
-        items_state->items = malloc(sizeof(struct Item) * 1);
-        items_state->items[0].text = strdup(message);
+        struct ItemsState *items_state = ItemsState_Alloc(1);
+        if (items_state == NULL)
+        {
+            log_error("Failed to allocate the message");
+            return false;
+        }
+        items_state->items[0].text = arena_strdup(&items_state->arena, message);
         items_state->items[0].background_color = "#000000";
         items_state->items[0].background_image = NULL;
-        items_state->items[0].image_exists = false;
         items_state->items[0].show_pill = state->show_pill;
         items_state->items[0].alignment = default_alignment;
         items_state->items[0].horizontal_alignment = default_horizontal_alignment;
         items_state->items[0].line_spacing = line_spacing;
+        items_state->items[0].max_lines = max_lines;
+        items_state->items[0].scale_quality = default_scale_quality;
 
         if (strcmp(state->background_color, "") != 0)
         {
-            items_state->items[0].background_color = strdup(state->background_color);
+            items_state->items[0].background_color = string_table_intern(&items_state->strings, &items_state->arena, state->background_color);
         }
 
         if (strcmp(state->background_image, "") != 0)
         {
-            items_state->items[0].background_image = strdup(state->background_image);
-            items_state->items[0].image_exists = access(state->background_image, F_OK) != -1;
+            items_state->items[0].background_image = string_table_intern(&items_state->strings, &items_state->arena, state->background_image);
         }
 
-        items_state->item_count = 1;
-        items_state->selected = 0;
+        if (items_state->items[0].text == NULL || items_state->items[0].background_color == NULL)
+        {
+            log_error("Failed to allocate the message");
+            ItemsState_Free(items_state);
+            return false;
+        }
         state->items_state = items_state;
     }
     else if (strcmp(state->file, "") != 0)
     {
-        state->items_state = ItemsState_New(state->file, state->item_key, state->background_image, state->background_color, state->show_pill, default_alignment);
+#ifdef DEBUG
+        unsigned long load_start = get_current_time_ms();
+#endif
+        state->items_state = ItemsState_New(state->file, state->item_key, state->background_image, state->background_color, state->show_pill, default_alignment, default_scale_quality);
         if (state->items_state == NULL)
         {
             log_error("Failed to hydrate display states");
             return false;
         }
+#ifdef DEBUG
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "loaded %zu items (%zu distinct strings) in %lu ms", state->items_state->item_count, state->items_state->strings.count, get_current_time_ms() - load_start);
+        log_error(buffer);
+        log_memory_usage("loaded");
+#endif
     }
     else
     {
@@ -1946,60 +5695,311 @@ void convert_escaped_newlines(char *str)
     *dst = '\0'; // Ensure null termination
 }
 
-// Get current time in milliseconds
-unsigned long get_current_time_ms()
+// spinner_sheet_create returns an empty ARGB sheet holding frame_count frames side by side
+SDL_Surface *spinner_sheet_create(int frame_count, int frame_width, int frame_height)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+    SDL_Surface *sheet = SDL_CreateRGBSurface(0, frame_count * frame_width, frame_height, 32, RGBA_MASK_8888);
+    if (sheet == NULL)
+    {
+        return NULL;
+    }
+    SDL_FillRect(sheet, NULL, SDL_MapRGBA(sheet->format, 0, 0, 0, 0));
+    return sheet;
 }
 
-// Update and design the spinner
-void update_spinner(SDL_Surface *screen)
+// spinner_build_chars rasterizes a character set with the spinner font
+bool spinner_build_chars(struct Spinner *spinner, const char **frames)
 {
-    if (!g_options.spinner.active)
-        return;
+    TTF_Font *font = TTF_OpenFont(FONT_PATH, SCALE1(SPINNER_SIZE));
+    if (font == NULL)
+    {
+        return false;
+    }
+
+    // every frame takes the width of the widest one
+    int frame_count = 0;
+    int frame_width = 1;
+    for (; frames[frame_count] != NULL; frame_count++)
+    {
+        int width = 0;
+        TTF_SizeUTF8(font, frames[frame_count], &width, NULL);
+        frame_width = MAX(frame_width, width);
+    }
+
+    spinner->sheet = spinner_sheet_create(frame_count, frame_width, TTF_FontHeight(font));
+    if (spinner->sheet == NULL)
+    {
+        TTF_CloseFont(font);
+        return false;
+    }
+
+    for (int i = 0; i < frame_count; i++)
+    {
+        SDL_Surface *rendered = TTF_RenderUTF8_Blended(font, frames[i], COLOR_WHITE);
+        if (rendered != NULL)
+        {
+            // copy the alpha channel as is instead of blending it onto the empty sheet
+            SDLX_SetAlpha(rendered, 0, 0);
+            SDL_Rect dst = {i * frame_width, 0, 0, 0};
+            SDL_BlitSurface(rendered, NULL, spinner->sheet, &dst);
+            SDL_FreeSurface(rendered);
+        }
+    }
+    TTF_CloseFont(font);
+
+    spinner->frame_count = frame_count;
+    spinner->frame_width = frame_width;
+    spinner->frame_height = spinner->sheet->h;
+    return true;
+}
+
+// spinner_build_strip loads a PNG strip of square frames laid out left to right
+bool spinner_build_strip(struct Spinner *spinner, const char *path)
+{
+    SDL_Surface *strip = IMG_Load(path);
+    if (strip == NULL)
+    {
+        return false;
+    }
+
+    int frame_count = strip->h > 0 ? strip->w / strip->h : 0;
+    if (frame_count == 0)
+    {
+        SDL_FreeSurface(strip);
+        return false;
+    }
+
+    spinner->sheet = spinner_sheet_create(frame_count, strip->h, strip->h);
+    if (spinner->sheet == NULL)
+    {
+        SDL_FreeSurface(strip);
+        return false;
+    }
+    SDLX_SetAlpha(strip, 0, 0);
+    SDL_BlitSurface(strip, NULL, spinner->sheet, NULL);
+    SDL_FreeSurface(strip);
+
+    spinner->frame_count = frame_count;
+    spinner->frame_width = spinner->sheet->h;
+    spinner->frame_height = spinner->sheet->h;
+    return true;
+}
+
+// spinner_build_arc draws a three-quarter ring fading towards its tail, rotated a step further in every frame
+bool spinner_build_arc(struct Spinner *spinner)
+{
+    int size = SCALE1(SPINNER_SIZE);
+    spinner->sheet = spinner_sheet_create(SPINNER_ARC_FRAMES, size, size);
+    if (spinner->sheet == NULL)
+    {
+        return false;
+    }
+
+    float center = size / 2.0f;
+    float thickness = MAX(size / 8.0f, 2.0f);
+    float radius = center - thickness / 2.0f - 0.5f;
+    float span = 1.5f * M_PI;
+
+    SDL_LockSurface(spinner->sheet);
+    for (int frame = 0; frame < SPINNER_ARC_FRAMES; frame++)
+    {
+        float rotation = frame * 2.0f * M_PI / SPINNER_ARC_FRAMES;
+        for (int y = 0; y < size; y++)
+        {
+            Uint32 *row = (Uint32 *)((Uint8 *)spinner->sheet->pixels + y * spinner->sheet->pitch) + frame * size;
+            for (int x = 0; x < size; x++)
+            {
+                float dx = x + 0.5f - center;
+                float dy = y + 0.5f - center;
+
+                // antialias the edges of the ring over one pixel
+                float coverage = thickness / 2.0f + 0.5f - fabsf(sqrtf(dx * dx + dy * dy) - radius);
+                if (coverage <= 0.0f)
+                {
+                    continue;
+                }
+                if (coverage > 1.0f)
+                {
+                    coverage = 1.0f;
+                }
+
+                float angle = atan2f(dy, dx) - rotation;
+                while (angle < 0.0f)
+                {
+                    angle += 2.0f * M_PI;
+                }
+                if (angle > span)
+                {
+                    continue;
+                }
+
+                Uint8 alpha = (Uint8)(255.0f * coverage * angle / span);
+                row[x] = SDL_MapRGBA(spinner->sheet->format, 255, 255, 255, alpha);
+            }
+        }
+    }
+    SDL_UnlockSurface(spinner->sheet);
+
+    spinner->frame_count = SPINNER_ARC_FRAMES;
+    spinner->frame_width = size;
+    spinner->frame_height = size;
+    return true;
+}
+
+// spinner_build rasterizes the frames of the spinner style once
+// every tick then only copies one frame from the sheet
+bool spinner_build(struct Spinner *spinner)
+{
+    bool built;
+    if (strcmp(spinner->style, "line") == 0)
+    {
+        built = spinner_build_chars(spinner, SPINNER_LINE_FRAMES);
+    }
+    else if (strcmp(spinner->style, "dots") == 0)
+    {
+        built = spinner_build_chars(spinner, SPINNER_DOTS_FRAMES);
+    }
+    else if (strcmp(spinner->style, "arc") == 0)
+    {
+        built = spinner_build_arc(spinner);
+    }
+    else
+    {
+        built = spinner_build_strip(spinner, spinner->style);
+    }
 
-    unsigned long current_time = get_current_time_ms();
-    if (current_time - g_options.spinner.last_update >= 100)
-    { // Update every 100ms
-        g_options.spinner.current_frame = (g_options.spinner.current_frame + 1) % SPINNER_FRAMES;
-        g_options.spinner.last_update = current_time;
+    if (!built)
+    {
+        log_error("Failed to build the spinner frames, the spinner is disabled.");
+        return false;
+    }
+
+    SDLX_SetAlpha(spinner->sheet, SDL_SRCALPHA, 255);
+    if (spinner->fps <= 0)
+    {
+        spinner->fps = SPINNER_DEFAULT_FPS;
+    }
+    spinner->start_time = get_current_time_ms();
+    return true;
+}
+
+// spinner_free releases the spinner frames and the pixels saved under it
+void spinner_free(struct Spinner *spinner)
+{
+    if (spinner->sheet != NULL)
+    {
+        SDL_FreeSurface(spinner->sheet);
+        spinner->sheet = NULL;
+    }
+    if (spinner->background != NULL)
+    {
+        SDL_FreeSurface(spinner->background);
+        spinner->background = NULL;
     }
+    spinner->background_saved = false;
+}
+
+// spinner_frame returns the frame the spinner should show now
+int spinner_frame(struct Spinner *spinner)
+{
+    unsigned long elapsed = get_current_time_ms() - spinner->start_time;
+    return (int)((elapsed * spinner->fps / 1000) % spinner->frame_count);
+}
+
+// spinner_needs_update returns true when the spinner should show another frame
+bool spinner_needs_update(struct Spinner *spinner)
+{
+    return spinner->active && spinner->sheet != NULL && spinner_frame(spinner) != spinner->current_frame;
+}
+
+// spinner_rect returns where the next spinner frame is drawn, just after the last message
+SDL_Rect spinner_rect(SDL_Surface *screen)
+{
+    struct Spinner *spinner = &g_options.spinner;
 
     // Position the spinner just after the last message
-    if (g_options.spinner.last_message_width > 0)
+    if (spinner->last_message_width > 0)
     {
         // Calculates position based on last message
-        g_options.spinner.x = g_options.spinner.last_message_x + g_options.spinner.last_message_width + SCALE1(10);
-        g_options.spinner.y = g_options.spinner.last_message_y;
+        spinner->x = spinner->last_message_x + spinner->last_message_width + SCALE1(10);
+        spinner->y = spinner->last_message_y;
     }
     else
     {
         // Default position if no message
-        g_options.spinner.x = screen->w - SCALE1(30);
-        g_options.spinner.y = screen->h - SCALE1(30);
+        spinner->x = screen->w - SCALE1(30);
+        spinner->y = screen->h - SCALE1(30);
     }
 
-    TTF_Font *font = TTF_OpenFont(FONT_PATH, SCALE1(20));
-    if (font)
+    // Center vertically in relation to text
+    int y = spinner->y + (spinner->last_message_height - spinner->frame_height) / 2;
+    SDL_Rect rect = {spinner->x, y, spinner->frame_width, spinner->frame_height};
+    return rect;
+}
+
+// update_spinner draws the current spinner frame just after the last message
+void update_spinner(SDL_Surface *screen)
+{
+    struct Spinner *spinner = &g_options.spinner;
+    if (!spinner->active || spinner->sheet == NULL)
+        return;
+
+    spinner->current_frame = spinner_frame(spinner);
+
+    SDL_Rect rect = spinner_rect(screen);
+    SDL_Rect src = {spinner->current_frame * spinner->frame_width, 0, spinner->frame_width, spinner->frame_height};
+    SDL_Rect dst = rect;
+    SDL_BlitSurface(spinner->sheet, &src, screen, &dst);
+    spinner->drawn = rect;
+}
+
+// draw_spinner replaces the previous spinner frame on screen with the current one
+// only the pixels under the spinner are saved and put back, and only when they changed
+void draw_spinner(SDL_Surface *screen, struct AppState *state)
+{
+    struct Spinner *spinner = &g_options.spinner;
+    if (!spinner->active || spinner->sheet == NULL)
+        return;
+
+    if (spinner->background == NULL)
     {
-        SDL_Color color = {255, 255, 255, 255}; // White
-        SDL_Surface *text = TTF_RenderUTF8_Blended(font,
-                                                   SPINNER_CHARS[g_options.spinner.current_frame], color);
+        spinner->background = SDL_CreateRGBSurface(0, spinner->frame_width, spinner->frame_height, screen->format->BitsPerPixel, screen->format->Rmask, screen->format->Gmask, screen->format->Bmask, screen->format->Amask);
+        if (spinner->background == NULL)
+        {
+            log_error("Failed to create background buffer for spinner optimization.");
+        }
+    }
 
-        if (text)
+    // anything drawn over the previous spinner this frame already removed it, at least in part
+    SDL_Rect previous = spinner->drawn;
+    bool previous_damaged = damage_intersects(&state->flip_damage, &previous);
+    if (previous.w > 0 && !state->flip_damage.full)
+    {
+        if (spinner->background_saved && !previous_damaged)
         {
-            SDL_Rect pos = {
-                g_options.spinner.x,
-                g_options.spinner.y + (g_options.spinner.last_message_height - text->h) / 2, // Center vertically in relation to text
-                text->w,
-                text->h};
-            SDL_BlitSurface(text, NULL, screen, &pos);
-            SDL_FreeSurface(text);
+            SDL_Rect dst = previous;
+            SDL_BlitSurface(spinner->background, NULL, screen, &dst);
         }
-        TTF_CloseFont(font);
+        else
+        {
+            damage_add(&state->damage, previous, screen);
+            draw_damage(screen, state);
+        }
+        damage_add(&state->flip_damage, previous, screen);
+    }
+
+    // the saved pixels stay valid as long as the spinner does not move and nothing is drawn under it
+    SDL_Rect next = spinner_rect(screen);
+    bool moved = next.x != previous.x || next.y != previous.y || previous.w == 0;
+    if (spinner->background != NULL && (!spinner->background_saved || moved || previous_damaged))
+    {
+        SDL_Rect src = next;
+        SDL_BlitSurface(screen, &src, spinner->background, NULL);
+        spinner->background_saved = true;
     }
+
+    update_spinner(screen);
+    damage_add(&state->flip_damage, spinner->drawn, screen);
 }
 
 // main is the entry point for the app
@@ -2040,8 +6040,17 @@ int main(int argc, char *argv[])
         .show_time_left = false,
         .items_state = NULL,
         .start_time = 0,
+        .countdown = {.shown = -1},
         .show_pill = false,
         .scroll_state = {.scroll_to_bottom = true}, // Initial display at bottom
+        .image_cache = {
+            .max_bytes = IMAGE_CACHE_DEFAULT_SIZE_MB * 1024 * 1024,
+            .lock = PTHREAD_MUTEX_INITIALIZER,
+            .decoded = PTHREAD_COND_INITIALIZER,
+        },
+        .prefetcher = {.depth = PREFETCH_DEFAULT_DEPTH},
+        .image_watch = {.fd = -1},
+        .prerender = {.item = -1},
     };
 
     // assign the default values to the app state
@@ -2071,10 +6080,8 @@ int main(int argc, char *argv[])
 
     swallow_stdout_from_function(init);
 
-    // Add a background buffer for the spinner + preserve_framebuffer optimization
-    SDL_Surface *background_buffer = NULL;
-    bool use_background_buffer = g_options.spinner.active;
-    bool buffer_initialized = false;
+    // the items are drawn to this screen from now on, prepare them for it
+    items_compile(state.items_state, screen);
 
     struct sigaction sa = {
         .sa_handler = signal_handler,
@@ -2089,11 +6096,30 @@ int main(int argc, char *argv[])
         return ExitCodeError;
     }
 
+    // the spinner frames are rasterized once, without them there is no spinner
+    if (g_options.spinner.active && !spinner_build(&g_options.spinner))
+    {
+        g_options.spinner.active = false;
+    }
+
+    // prepared images are kept on disk between runs when asked to
+    if (state.image_cache.disk_cache_dir[0] != '\0' && !disk_cache_open(state.image_cache.disk_cache_dir))
+    {
+        log_error("Cannot use the disk cache directory, images are decoded every run.");
+        state.image_cache.disk_cache_dir[0] = '\0';
+    }
+
+    // watch for the background images that do not exist yet or get rewritten
+    image_watch_start(&state.image_watch, state.items_state);
+
+    // decode the images of the neighbouring items while the selected one is shown
+    prefetch_start(&state.prefetcher, &state);
+
     // get initial wifi state
     // int was_online = PLAT_isOnline();
 
     // get the current time
-    gettimeofday(&state.start_time, NULL);
+    state.start_time = get_current_time_ms();
 
     int show_setting = 0; // 1=brightness,2=volume
 
@@ -2122,62 +6148,65 @@ int main(int argc, char *argv[])
         // }
         // was_online = is_online;
 
+        // show the background images that appeared or changed
+        image_watch_update(&state.image_watch, &state);
+
         // handle any input events
         handle_input(&state);
+        scroll_animate(&state);
+        prefetch_update(&state.prefetcher, state.items_state);
 
-        bool spinner_needs_update = false;
-        if (g_options.spinner.active)
+        // swap the placeholder for the image once the prefetch worker cached something new
+        if (state.image_pending != NULL && image_cache_insertions(&state.image_cache) != state.image_insertions)
         {
-            unsigned long current_time = get_current_time_ms();
-            if (current_time - g_options.spinner.last_update >= 100)
-            {
-                spinner_needs_update = true;
-            }
+            state.image_pending = NULL;
+            state.redraw = 1;
         }
 
         // redraw the screen if there has been a change
-        if (state.redraw || spinner_needs_update)
-        {
-            if (use_background_buffer && !state.redraw && buffer_initialized) {
-                // Optimization: restore from buffer instead of redrawing everything
-                SDL_BlitSurface(background_buffer, NULL, screen, NULL);
-            } else {
-                // Do not clean the screen at the start of each loop if preserve_framebuffer is active
-                if (!g_options.preserve_framebuffer)
-                {
-                    GFX_clear(screen);
-                }
-                draw_screen(screen, &state);
-                
-                // Initialize buffer after first complete draw
-                if (use_background_buffer && !buffer_initialized) {
-                    background_buffer = SDL_CreateRGBSurface(screen->flags, screen->w, screen->h, screen->format->BitsPerPixel, screen->format->Rmask, screen->format->Gmask, screen->format->Bmask, screen->format->Amask);
-                    if (background_buffer) {
-                        SDL_BlitSurface(screen, NULL, background_buffer, NULL);
-                        buffer_initialized = true;
-                    } else {
-                        log_error("Failed to create background buffer for spinner optimization.");
-                        use_background_buffer = false;
-                    }
-                }
+        bool damaged = state.damage.full || state.damage.count > 0;
+        if (state.redraw || damaged || spinner_needs_update(&g_options.spinner))
+        {
+            // when flipping swaps the pixels, the screen holds an older frame and must be drawn in full
+            if (state.framebuffer_moves)
+            {
+                state.redraw = 1;
             }
 
-            // Draw the spinner if active
-            if (g_options.spinner.active)
+            if (state.redraw)
             {
-                if (use_background_buffer && state.redraw && buffer_initialized) {
-                    // Update the buffer with the new background
-                    SDL_BlitSurface(screen, NULL, background_buffer, NULL);
+                // a composed next item is a single copy, scrolling shifts the text already on screen,
+                // anything else draws everything
+                // (the background is drawn over the whole screen, clearing it first is not needed)
+                if (!prerender_present(screen, &state) && !scroll_screen(screen, &state))
+                {
+                    draw_screen(screen, &state);
                 }
-                update_spinner(screen);
+                damage_reset(&state.damage);
+                damage_add_all(&state.flip_damage);
+            }
+            else if (damaged)
+            {
+                draw_damage(screen, &state);
             }
 
+            // Draw the spinner if active
+            draw_spinner(screen, &state);
+
             // sync the screen
-            GFX_flip(screen);
+            void *pixels = screen->pixels;
+            flip_screen(screen, &state.flip_damage);
+            if (screen->pixels != pixels)
+            {
+                state.framebuffer_moves = true;
+            }
         }
         else
         {
-            SDL_Delay(16); // Reduce CPU usage when idle
+            // compose the next item while there is nothing else to do
+            prerender_next(screen, &state);
+
+            image_watch_wait(&state.image_watch, 16); // Reduce CPU usage when idle, waking up when an image appears
             // Slows down the frame rate to match the refresh rate of the screen
             // when the screen is not being redrawn
             GFX_sync();
@@ -2186,24 +6215,42 @@ int main(int argc, char *argv[])
         // if the sleep seconds is larger than 0, check if the sleep has expired
         if (state.timeout_seconds > 0)
         {
-            struct timeval current_time;
-            gettimeofday(& current_time, NULL);
-            if (current_time.tv_sec - state.start_time.tv_sec >= state.timeout_seconds)
+            if (get_current_time_ms() - state.start_time >= (unsigned long)state.timeout_seconds * 1000)
             {
                 state.exit_code = ExitCodeTimeout;
                 state.quitting = 1;
             }
 
-            if (current_time.tv_sec != state.start_time.tv_sec && state.show_time_left)
+            // only the countdown label changes, and only when the seconds shown change
+            if (state.show_time_left)
             {
-                state.redraw = 1;
+                SDL_Rect previous = countdown_rect(&state);
+                if (countdown_update(&state))
+                {
+                    damage_add(&state.damage, previous, screen);
+                    damage_add(&state.damage, countdown_rect(&state), screen);
+                }
             }
         }
     }
 
-    if (background_buffer) {
-        SDL_FreeSurface(background_buffer);
+    for (int i = 0; i < state.items_state->item_count; i++)
+    {
+        text_layout_free(&state.items_state->items[i].layout);
     }
+#ifdef DEBUG
+    log_memory_usage("exit");
+#endif
+
+    prefetch_stop(&state.prefetcher);
+    scale_pool_stop(&scale_pool);
+    image_watch_stop(&state.image_watch);
+    prerender_free(&state.prerender);
+    ItemsState_Free(state.items_state);
+    image_cache_free(&state.image_cache);
+    spinner_free(&g_options.spinner);
+    glyph_atlas_free_all();
+    font_metrics_free_all();
 
     swallow_stdout_from_function(destruct);
 
@@ -2229,10 +6276,17 @@ void print_help(const char *program_name)
     printf("  -M, --message-alignment AL Vertical alignment: top, middle, bottom\n");
     printf("  -h, --horizontal-alignment Horizontal alignment: left, center, right\n");
     printf("  -l, --line-spacing N       Line spacing (default: %d)\n", PADDING);
+    printf("  -L, --max-lines N          Maximum lines shown, the last one ends with \"...\" (default: 0, no limit)\n");
     printf("  -N, --no-wrap              Disable automatic text wrapping\n");
     printf("  -P, --show-pill            Show items in pills/bubbles\n");
     printf("  -s, --show-spinner         Show loading spinner\n");
-    printf("  -p, --preserve-framebuffer Preserve framebuffer\n\n");
+    printf("  -g, --spinner-style STYLE  Spinner style: line, dots, arc or the path to a PNG strip of square frames (default: line)\n");
+    printf("  -G, --spinner-fps N        Spinner frames per second (default: %d)\n", SPINNER_DEFAULT_FPS);
+    printf("  -p, --preserve-framebuffer Preserve framebuffer\n");
+    printf("  -O, --image-cache-size MB  Memory cap for decoded images, 0 to %d (default: %d)\n", IMAGE_CACHE_MAX_SIZE_MB, IMAGE_CACHE_DEFAULT_SIZE_MB);
+    printf("  -k, --disk-cache-dir PATH  Keep scaled images in PATH between runs (default: disabled)\n");
+    printf("  -R, --prefetch-depth N     Items ahead to decode in the background, 0 to %d, 0 disables it (default: %d)\n", PREFETCH_MAX_DEPTH, PREFETCH_DEFAULT_DEPTH);
+    printf("  -q, --scale-quality Q      Image scaling filter: nearest, bilinear, box, lanczos3 (default: box)\n\n");
     
     printf("BUTTON OPTIONS:\n");
     printf("  -c, --confirm-button BTN   Confirm button (A, B, X, Y)\n");
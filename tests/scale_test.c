@@ -0,0 +1,194 @@
+// scale_test compares the box filter of scale_surface with the column-major scaler it replaced
+// every channel must stay within one level of the reference, the new scaler rounds where the old one truncated
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "image_scale.h"
+
+// ScaleCase is one scaling to check, in every pixel format
+struct ScaleCase
+{
+    int src_w;
+    int src_h;
+    int dst_w;
+    int dst_h;
+};
+
+// PixelFormat is a pixel format to check the cases in
+struct PixelFormat
+{
+    const char *name;
+    int bpp;
+    Uint32 masks[4];
+};
+
+// reference_scale is the scaler scale_surface replaced: it walks the destination column by column
+// and averages every covered source pixel; 16-bit pixels are averaged per masked channel,
+// as the old scaler averaged their bytes and mixed the channels of 565 pixels
+SDL_Surface *reference_scale(SDL_Surface *surface, Uint16 width, Uint16 height)
+{
+    SDL_PixelFormat *format = surface->format;
+    SDL_Surface *scaled = SDL_CreateRGBSurface(0, width, height, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    if (scaled == NULL)
+    {
+        return NULL;
+    }
+
+    int bpp = format->BytesPerPixel;
+    Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+    Uint8 shifts[4] = {format->Rshift, format->Gshift, format->Bshift, format->Ashift};
+
+    for (int x = 0; x < width; x++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            int xo1 = x * surface->w / width;
+            int xo2 = (x + 1) * surface->w / width;
+            xo2 = xo2 > xo1 ? xo2 : xo1 + 1;
+            int yo1 = y * surface->h / height;
+            int yo2 = (y + 1) * surface->h / height;
+            yo2 = yo2 > yo1 ? yo2 : yo1 + 1;
+            int n = (xo2 - xo1) * (yo2 - yo1);
+
+            Uint32 v[4] = {0, 0, 0, 0};
+            for (int xo = xo1; xo < xo2; xo++)
+            {
+                for (int yo = yo1; yo < yo2; yo++)
+                {
+                    Uint8 *ps = (Uint8 *)surface->pixels + yo * surface->pitch + xo * bpp;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        v[i] += bpp == 2 ? (*(Uint16 *)ps & masks[i]) >> shifts[i] : ps[i];
+                    }
+                }
+            }
+
+            Uint8 *pd = (Uint8 *)scaled->pixels + y * scaled->pitch + x * bpp;
+            if (bpp == 2)
+            {
+                Uint16 pixel = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    pixel |= ((v[i] / n) << shifts[i]) & masks[i];
+                }
+                *(Uint16 *)pd = pixel;
+            }
+            else
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    pd[i] = v[i] / n;
+                }
+            }
+        }
+    }
+
+    return scaled;
+}
+
+// fill_surface fills a surface with noise over a gradient, so neighbouring pixels differ
+void fill_surface(SDL_Surface *surface, unsigned int seed)
+{
+    int bpp = surface->format->BytesPerPixel;
+    for (int y = 0; y < surface->h; y++)
+    {
+        Uint8 *row = (Uint8 *)surface->pixels + y * surface->pitch;
+        for (int i = 0; i < surface->w * bpp; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            row[i] = (Uint8)((seed >> 16) % 64 + (i * 192) / (surface->w * bpp));
+        }
+    }
+}
+
+// compare_surfaces returns the largest difference of a channel between two surfaces of the same format
+int compare_surfaces(SDL_Surface *a, SDL_Surface *b)
+{
+    SDL_PixelFormat *format = a->format;
+    Uint32 masks[4] = {format->Rmask, format->Gmask, format->Bmask, format->Amask};
+    Uint8 shifts[4] = {format->Rshift, format->Gshift, format->Bshift, format->Ashift};
+    int bpp = format->BytesPerPixel;
+
+    int worst = 0;
+    for (int y = 0; y < a->h; y++)
+    {
+        for (int x = 0; x < a->w; x++)
+        {
+            Uint8 *pa = (Uint8 *)a->pixels + y * a->pitch + x * bpp;
+            Uint8 *pb = (Uint8 *)b->pixels + y * b->pitch + x * bpp;
+            for (int i = 0; i < 4; i++)
+            {
+                int va = bpp == 2 ? (int)((*(Uint16 *)pa & masks[i]) >> shifts[i]) : pa[i];
+                int vb = bpp == 2 ? (int)((*(Uint16 *)pb & masks[i]) >> shifts[i]) : pb[i];
+                int difference = abs(va - vb);
+                worst = difference > worst ? difference : worst;
+            }
+        }
+    }
+    return worst;
+}
+
+int main(void)
+{
+    struct ScaleCase cases[] = {
+        {640, 480, 320, 240},  // even downscale
+        {333, 217, 101, 67},   // odd widths
+        {7, 5, 3, 2},          // tiny
+        {1000, 3, 7, 1},       // uneven coverage
+        {5, 3, 17, 11},        // upscale
+        {40, 30, 41, 29},      // up one axis, down the other
+        {1, 100, 1, 7},        // 1xN
+        {100, 1, 9, 1},        // Nx1
+        {1, 1, 3, 3},          // a single pixel
+        {1200, 900, 500, 400}, // large enough to be split into bands across threads
+    };
+    struct PixelFormat formats[] = {
+        {"argb8888", 32, {0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000}},
+        {"rgb565", 16, {0xF800, 0x07E0, 0x001F, 0}},
+    };
+
+    int failures = 0;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        struct PixelFormat *format = &formats[f];
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+        {
+            struct ScaleCase *scale = &cases[c];
+            SDL_Surface *source = SDL_CreateRGBSurface(0, scale->src_w, scale->src_h, format->bpp, format->masks[0], format->masks[1], format->masks[2], format->masks[3]);
+            if (source == NULL)
+            {
+                printf("FAIL %s %dx%d: cannot create the source\n", format->name, scale->src_w, scale->src_h);
+                failures++;
+                continue;
+            }
+            fill_surface(source, (unsigned int)(c * 31 + f));
+
+            SDL_Surface *expected = reference_scale(source, scale->dst_w, scale->dst_h);
+            SDL_Surface *scaled = scale_surface(source, scale->dst_w, scale->dst_h, ScaleQualityBox);
+            if (expected == NULL || scaled == NULL)
+            {
+                printf("FAIL %s %dx%d -> %dx%d: cannot scale\n", format->name, scale->src_w, scale->src_h, scale->dst_w, scale->dst_h);
+                failures++;
+            }
+            else
+            {
+                int worst = compare_surfaces(scaled, expected);
+                printf("%s %s %dx%d -> %dx%d: max difference %d\n", worst <= 1 ? "ok  " : "FAIL", format->name, scale->src_w, scale->src_h, scale->dst_w, scale->dst_h, worst);
+                failures += worst > 1;
+            }
+
+            SDL_FreeSurface(scaled);
+            SDL_FreeSurface(expected);
+            SDL_FreeSurface(source);
+        }
+    }
+
+    scale_pool_stop(&scale_pool);
+
+    if (failures > 0)
+    {
+        printf("%d scalings differ from the reference\n", failures);
+        return 1;
+    }
+    return 0;
+}